@@ -0,0 +1,20 @@
+TEMPLATE = app
+TARGET = benchmark
+INCLUDEPATH += . ../Source
+
+CONFIG += console
+CONFIG += c++11
+CONFIG += thread
+CONFIG -= qt
+
+LIBS += -L../Source -lSource
+PRE_TARGETDEPS += ../Source/libSource.so
+
+# Tag the results with the revision they were measured on.
+BENCHMARK_REVISION = $$system(git rev-parse --short HEAD 2>/dev/null)
+!isEmpty(BENCHMARK_REVISION): DEFINES += BENCHMARK_REVISION=\\\"$$BENCHMARK_REVISION\\\"
+
+# Input
+HEADERS += fixtures.h
+SOURCES += benchmark.cpp \
+    fixtures.cpp
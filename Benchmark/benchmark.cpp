@@ -0,0 +1,605 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#include "fixtures.h"
+
+#include <console.h>
+#include <directory.h>
+#include <instrumentation.h>
+#include <process.h>
+#include <threadgroup.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef BENCHMARK_REVISION
+# define BENCHMARK_REVISION "unknown"
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief The Result struct  One line of the report.
+ */
+struct Result
+{
+    std::string name;
+    size_t size;
+    uint64_t iterations;
+    double seconds;
+
+    /**
+     * @brief latencies  Per iteration, in nanoseconds (empty for throughput benchmarks).
+     */
+    std::vector<double> latencies;
+};
+
+struct Options
+{
+    std::string filter;
+    double scale = 1;
+};
+
+std::vector<Result> results;
+Options options;
+
+bool selected(const std::string &name)
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+uint64_t scaled(uint64_t iterations)
+{
+    return std::max<uint64_t>(1, iterations * options.scale);
+}
+
+double secondsSince(Clock::time_point startTime)
+{
+    return std::chrono::duration<double>(Clock::now() - startTime).count();
+}
+
+/**
+ * @brief measureLatency  Run @arg function @arg iterations times, timing every run.
+ */
+void measureLatency(const std::string &name, size_t size, uint64_t iterations, const std::function<void()> &function)
+{
+    Result result{ name, size, iterations, 0, {} };
+
+    result.latencies.reserve(iterations);
+
+    const auto startTime = Clock::now();
+
+    for(uint64_t i = 0; i < iterations; ++i) {
+        const auto iterationStart = Clock::now();
+
+        function();
+
+        result.latencies.push_back(std::chrono::duration<double, std::nano>(Clock::now() - iterationStart).count());
+    }
+
+    result.seconds = secondsSince(startTime);
+
+    results.push_back(std::move(result));
+}
+
+/**
+ * @brief measureThroughput  Run @arg function @arg iterations times, timing only the whole loop.
+ */
+void measureThroughput(const std::string &name, size_t size, uint64_t iterations, const std::function<void()> &function)
+{
+    const auto startTime = Clock::now();
+
+    for(uint64_t i = 0; i < iterations; ++i)
+        function();
+
+    results.push_back(Result{ name, size, iterations, secondsSince(startTime), {} });
+}
+
+void benchmarkAttach()
+{
+    if(!selected("attach_detach"))
+        return;
+
+    Fixture fixture(Fixture::Spinner);
+
+    measureLatency("attach_detach", 0, scaled(200), [&] {
+        Process process(fixture.getProcessID());
+    });
+}
+
+void benchmarkMemory()
+{
+    const size_t heapSize = 16*1024*1024;
+
+    if(!selected("read_word") && !selected("write_word") && !selected("read_bulk") && !selected("write_bulk"))
+        return;
+
+    // The bulk transfers start one byte in, to cover the unaligned head and tail: one more byte for the biggest.
+    Fixture fixture(Fixture::LargeHeap, heapSize + 1);
+    Process process(fixture.getProcessID());
+
+    const Process::MemoryAddress heap = fixture.getAddress();
+    std::vector<Process::Byte> buffer(heapSize);
+
+    if(selected("read_word")) {
+        const size_t words = 64*1024;
+
+        measureThroughput("read_word", words * sizeof(Process::Register), scaled(4), [&] {
+            for(size_t i = 0; i < words; ++i)
+                process.copyFrom(heap + i*sizeof(Process::Register));
+        });
+    }
+
+    if(selected("write_word")) {
+        const size_t words = 64*1024;
+
+        measureThroughput("write_word", words * sizeof(Process::Register), scaled(4), [&] {
+            for(size_t i = 0; i < words; ++i)
+                process.move(i, heap + i*sizeof(Process::Register));
+        });
+    }
+
+    for(size_t size = 1; size <= heapSize; size *= 16) {
+        // Roughly the same number of bytes for every size, without spending forever on the tiny ones.
+        const uint64_t iterations = scaled(std::min<size_t>(200000, std::max<size_t>(16, 4*1024*1024 / size)));
+
+        if(selected("read_bulk"))
+            measureThroughput("read_bulk", size, iterations, [&] {
+                process.read(heap + 1, buffer.data(), size);
+            });
+
+        if(selected("write_bulk"))
+            measureThroughput("write_bulk", size, iterations, [&] {
+                process.write(buffer.data(), size, heap + 1);
+            });
+    }
+}
+
+void benchmarkStep()
+{
+    if(!selected("single_step"))
+        return;
+
+    Fixture fixture(Fixture::Spinner);
+    Process process(fixture.getProcessID());
+
+    measureThroughput("single_step", 0, scaled(100000), [&] {
+        process.step();
+        process.wait();
+    });
+}
+
+void benchmarkSyscallStop()
+{
+    if(!selected("syscall_stop"))
+        return;
+
+    Fixture fixture(Fixture::SyscallLoop);
+    Process process(fixture.getProcessID());
+
+    // Two stops (entry and exit) per system call.
+    measureThroughput("syscall_stop", 0, scaled(100000), [&] {
+        process.continueAndStopOnSystemCall();
+        process.wait();
+    });
+}
+
+void benchmarkProc()
+{
+    if(selected("proc_enumeration")) {
+        Fixture fixture(Fixture::ThreadServer, 100);
+
+        measureLatency("proc_enumeration", 0, scaled(200), [] {
+            PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestProcfs);
+
+            Directory directory("/proc");
+
+            directory.getFiles();
+        });
+
+        const std::string taskPath = "/proc/" + std::to_string(fixture.getProcessID()) + "/task";
+
+        measureLatency("task_enumeration", 101, scaled(1000), [&] {
+            PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestProcfs);
+
+            Directory directory(taskPath);
+
+            directory.getFiles();
+        });
+    }
+
+    if(selected("name_lookup")) {
+        // A name nobody has: the whole of /proc is scanned.
+        measureLatency("name_lookup", 0, scaled(20), [] {
+            try {
+                Process::programNameToProcessID("no-such-benchmark-program");
+            }
+            catch(const std::invalid_argument &) {
+            }
+        });
+    }
+}
+
+void benchmarkGroupStop()
+{
+    if(!selected("group_stop"))
+        return;
+
+    for(size_t threadsCount : { 10, 100, 500 }) {
+        Fixture fixture(Fixture::ThreadServer, threadsCount);
+        ThreadGroup threadGroup(fixture.getProcessID());
+
+        Result result{ "group_stop", threadGroup.getThreadIDs().size(), scaled(100), 0, {} };
+
+        const auto startTime = Clock::now();
+
+        // The latency is the pause of the whole group: from the first interrupt until every thread runs again.
+        for(uint64_t i = 0; i < result.iterations; ++i) {
+            threadGroup.stop();
+            threadGroup.resume();
+
+            result.latencies.push_back(std::chrono::duration<double, std::nano>(threadGroup.getStopStatistics().pauseTime).count());
+        }
+
+        result.seconds = secondsSince(startTime);
+
+        results.push_back(std::move(result));
+    }
+}
+
+/**
+ * @brief connectToConsole  Connect to the console socket at @arg path, waiting for it to listen.
+ * @return The socket, or -1.
+ */
+int connectToConsole(const std::string &path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    for(unsigned int attempt = 0; attempt < 5000; ++attempt) {
+        const int descriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        if(descriptor < 0)
+            return -1;
+
+        if(::connect(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0)
+            return descriptor;
+
+        ::close(descriptor);
+
+        if(errno != ENOENT && errno != ECONNREFUSED && errno != EAGAIN)
+            return -1;
+
+        ::usleep(1000);
+    }
+
+    return -1;
+}
+
+/**
+ * @brief sendCommand  Send @arg command and read its reply, one line.
+ */
+bool sendCommand(int descriptor, const std::string &command, std::string &reply)
+{
+    if(::send(descriptor, command.data(), command.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(command.size()))
+        return false;
+
+    reply.clear();
+
+    while(reply.empty() || reply.back() != '\n') {
+        char buffer[256];
+
+        const ssize_t bytesRead = ::read(descriptor, buffer, sizeof(buffer));
+
+        if(bytesRead <= 0)
+            return false;
+
+        reply.append(buffer, bytesRead);
+    }
+
+    return true;
+}
+
+/**
+ * @brief runConsoleClient  A client process: wait for @arg startDescriptor, then send @arg commandsCount commands one
+ * after the other, keeping the latency of each in @arg latencies.
+ */
+void runConsoleClient(const std::string &path, int startDescriptor, double *latencies, uint64_t commandsCount)
+{
+    std::string command;
+    std::string reply;
+
+    command.reserve(64);
+    reply.reserve(256);
+
+    char start;
+
+    if(::read(startDescriptor, &start, 1) != 1)
+        ::_exit(1);
+
+    const int descriptor = connectToConsole(path);
+
+    if(descriptor < 0)
+        ::_exit(1);
+
+    for(uint64_t i = 0; i < commandsCount; ++i) {
+        command = "ping " + std::to_string(i) + "\n";
+
+        const auto startTime = Clock::now();
+
+        if(!sendCommand(descriptor, command, reply) || reply.compare(0, reply.size() - 1, command, 5, command.size() - 6) != 0)
+            ::_exit(1);
+
+        latencies[i] = std::chrono::duration<double, std::nano>(Clock::now() - startTime).count();
+    }
+
+    ::close(descriptor);
+    ::_exit(0);
+}
+
+void benchmarkConsoleServer()
+{
+    if(!selected("console_server"))
+        return;
+
+    const size_t clientsCount = 100;
+    const uint64_t commandsCount = scaled(1000);
+    const std::string path = "/tmp/process-benchmark-" + std::to_string(::getpid()) + ".sock";
+
+    // The clients write their latencies here, a row each.
+    const size_t latenciesSize = clientsCount * commandsCount * sizeof(double);
+    void *mapping = ::mmap(nullptr, latenciesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if(mapping == MAP_FAILED)
+        throw std::runtime_error("console_server: mmap() failed");
+
+    double *latencies = static_cast<double *>(mapping);
+
+    int startPipe[2];
+
+    if(::pipe(startPipe) < 0)
+        throw std::runtime_error("console_server: pipe() failed");
+
+    // Fork the clients before the server thread starts, so they don't inherit locks held by it.
+    std::vector<pid_t> clients;
+
+    for(size_t i = 0; i < clientsCount; ++i) {
+        const pid_t client = ::fork();
+
+        if(client == 0) {
+            ::close(startPipe[1]);
+
+            runConsoleClient(path, startPipe[0], latencies + i * commandsCount, commandsCount);
+        }
+
+        if(client > 0)
+            clients.push_back(client);
+    }
+
+    ::close(startPipe[0]);
+
+    Console console;
+
+    console.addOption("ping", 1, [](const std::list<std::string> &arguments) {
+        Console::write(arguments.back());
+    });
+
+    console.addOption("stop", 0, [&console](const std::list<std::string> &) {
+        Console::write("stopping");
+
+        console.stop();
+    });
+
+    std::thread server([&console, &path] {
+        console.serve(path);
+    });
+
+    const auto startTime = Clock::now();
+
+    const std::vector<char> start(clients.size(), 's');
+
+    if(::write(startPipe[1], start.data(), start.size()) != static_cast<ssize_t>(start.size()))
+        clients.clear();
+
+    ::close(startPipe[1]);
+
+    size_t failedClients = clientsCount - clients.size();
+
+    for(pid_t client : clients) {
+        int status;
+
+        if(::waitpid(client, &status, 0) != client || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ++failedClients;
+    }
+
+    const double seconds = secondsSince(startTime);
+
+    // Stop the server like any client would; the reply must make it out before the connections close.
+    const int descriptor = connectToConsole(path);
+    std::string reply;
+
+    const bool stopped = descriptor >= 0 && sendCommand(descriptor, "stop\n", reply) && reply == "stopping\n";
+
+    if(descriptor < 0)
+        console.stop();
+    else
+        ::close(descriptor);
+
+    server.join();
+
+    Result result{ "console_server", clientsCount, clientsCount * commandsCount, seconds, {} };
+
+    result.latencies.assign(latencies, latencies + clientsCount * commandsCount);
+
+    ::munmap(mapping, latenciesSize);
+
+    if(failedClients > 0)
+        throw std::runtime_error("console_server: " + std::to_string(failedClients) + " clients failed");
+
+    if(!stopped)
+        throw std::runtime_error("console_server: no reply to stop");
+
+    results.push_back(std::move(result));
+}
+
+double percentile(std::vector<double> values, double percent)
+{
+    if(values.empty())
+        return 0;
+
+    const size_t index = std::min(values.size()-1, static_cast<size_t>(values.size() * percent / 100));
+
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+
+    return values[index];
+}
+
+std::string escape(const std::string &string)
+{
+    std::string escaped;
+
+    for(char character : string) {
+        if(character == '"' || character == '\\')
+            escaped.push_back('\\');
+
+        if(static_cast<unsigned char>(character) >= 0x20)
+            escaped.push_back(character);
+    }
+
+    return escaped;
+}
+
+/**
+ * @brief report  One JSON document: the revision and machine, then a result per benchmark, then the instrumentation counters.
+ */
+void report(std::ostream &stream)
+{
+    utsname machine;
+
+    ::uname(&machine);
+
+    stream << "{\"revision\":\"" << escape(BENCHMARK_REVISION)
+           << "\",\"kernel\":\"" << escape(machine.release)
+           << "\",\"machine\":\"" << escape(machine.machine)
+           << "\",\"results\":[";
+
+    for(size_t i = 0; i < results.size(); ++i) {
+        const Result &result = results[i];
+
+        char line[512];
+
+        std::snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"size\":%zu,\"iterations\":%llu,\"seconds\":%.6f,\"per_second\":%.1f",
+                      i == 0 ? "" : ",", result.name.c_str(), result.size, static_cast<unsigned long long>(result.iterations),
+                      result.seconds, result.iterations / result.seconds);
+
+        stream << line;
+
+        if(result.size != 0 && result.latencies.empty()) {
+            std::snprintf(line, sizeof(line), ",\"mb_per_second\":%.1f", result.size * result.iterations / result.seconds / (1024*1024));
+
+            stream << line;
+        }
+
+        if(!result.latencies.empty()) {
+            std::snprintf(line, sizeof(line), ",\"p50_ns\":%.0f,\"p99_ns\":%.0f,\"max_ns\":%.0f",
+                          percentile(result.latencies, 50), percentile(result.latencies, 99),
+                          *std::max_element(result.latencies.begin(), result.latencies.end()));
+
+            stream << line;
+        }
+
+        stream << '}';
+    }
+
+    stream << "\n],\"instrumentation\":" << Instrumentation::snapshot().toJson() << "}\n";
+}
+
+void usage(const char *programName)
+{
+    std::cerr << "Usage: " << programName << " [--filter NAME] [--scale FACTOR]\n"
+              << "  --filter NAME    Run only the benchmarks whose name contains NAME.\n"
+              << "  --scale FACTOR   Multiply the iterations counts (e.g. 0.1 for a quick run).\n";
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    for(int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+
+        if(argument == "--filter" && i+1 < argc) {
+            options.filter = argv[++i];
+        }
+        else if(argument == "--scale" && i+1 < argc) {
+            options.scale = std::atof(argv[++i]);
+        }
+        else {
+            usage(argv[0]);
+
+            return 1;
+        }
+    }
+
+    try {
+        benchmarkAttach();
+        benchmarkMemory();
+        benchmarkStep();
+        benchmarkSyscallStop();
+        benchmarkProc();
+        benchmarkGroupStop();
+        benchmarkConsoleServer();
+    }
+    catch(const std::exception &exception) {
+        std::cerr << "benchmark failed: " << exception.what() << std::endl;
+
+        return 1;
+    }
+
+    report(std::cout);
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#include "fixtures.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+volatile unsigned long spinnerCounter = 0;
+
+int blockingPipe[2];
+
+void *blockedThread(void *)
+{
+    char byte;
+
+    // Nobody writes to the pipe; the thread waits like an idle worker.
+    while(::read(blockingPipe[0], &byte, 1) < 0)
+        ;
+
+    return nullptr;
+}
+
+}
+
+Fixture::Fixture(Type type, size_t size)
+{
+    int readyPipe[2];
+
+    if(::pipe(readyPipe) < 0)
+        throw std::runtime_error("Fixture: pipe() failed");
+
+    processID = ::fork();
+
+    if(processID < 0)
+        throw std::runtime_error("Fixture: fork() failed");
+
+    if(processID == 0) {
+        ::close(readyPipe[0]);
+
+        runChild(type, size, readyPipe[1]);
+
+        ::_exit(0);
+    }
+
+    ::close(readyPipe[1]);
+
+    ReadyMessage message;
+
+    const bool ready = ::read(readyPipe[0], &message, sizeof(message)) == sizeof(message);
+
+    ::close(readyPipe[0]);
+
+    if(!ready) {
+        ::kill(processID, SIGKILL);
+        ::waitpid(processID, nullptr, 0);
+
+        throw std::runtime_error("Fixture: the child failed to start");
+    }
+
+    address = message.address;
+    this->size = message.size;
+}
+
+Fixture::~Fixture()
+{
+    ::kill(processID, SIGKILL);
+    ::waitpid(processID, nullptr, __WALL);
+}
+
+void Fixture::runChild(Type type, size_t size, int readyDescriptor)
+{
+    ReadyMessage message{ 0, size };
+
+    switch(type) {
+    case Spinner:
+        message.address = reinterpret_cast<Process::MemoryAddress>(&spinnerCounter);
+        message.size = sizeof(spinnerCounter);
+
+        ::write(readyDescriptor, &message, sizeof(message));
+
+        while(true)
+            ++spinnerCounter;
+
+    case LargeHeap: {
+        void *block = std::malloc(size);
+
+        if(block == nullptr)
+            ::_exit(1);
+
+        // Touch every page, so reads don't measure page faults.
+        std::memset(block, 0x5a, size);
+
+        message.address = reinterpret_cast<Process::MemoryAddress>(block);
+
+        ::write(readyDescriptor, &message, sizeof(message));
+
+        while(true)
+            ::pause();
+    }
+
+    case SyscallLoop:
+        ::write(readyDescriptor, &message, sizeof(message));
+
+        while(true)
+            ::syscall(SYS_getppid);
+
+    case ThreadServer: {
+        if(::pipe(blockingPipe) < 0)
+            ::_exit(1);
+
+        pthread_attr_t attributes;
+
+        pthread_attr_init(&attributes);
+        pthread_attr_setstacksize(&attributes, 64*1024);
+
+        for(size_t i = 0; i < size; ++i) {
+            pthread_t thread;
+
+            if(pthread_create(&thread, &attributes, blockedThread, nullptr) != 0)
+                ::_exit(1);
+        }
+
+        ::write(readyDescriptor, &message, sizeof(message));
+
+        while(true)
+            ::pause();
+    }
+    }
+}
@@ -0,0 +1,90 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#ifndef FIXTURES_H
+#define FIXTURES_H
+
+#include <process.h>
+
+#include <string>
+
+/**
+ * @brief The Fixture class  A tracee for the benchmarks: a forked child running one of the fixture loops.
+ * The child is killed when the fixture is destroyed.
+ */
+class Fixture
+{
+public:
+    enum Type {
+        /**
+         * @brief Spinner  Increments a counter forever (address: the counter).
+         */
+        Spinner,
+
+        /**
+         * @brief LargeHeap  Allocates and touches a big heap block, then sleeps (address, size: the block).
+         */
+        LargeHeap,
+
+        /**
+         * @brief SyscallLoop  Calls getppid() forever.
+         */
+        SyscallLoop,
+
+        /**
+         * @brief ThreadServer  Starts many threads blocked on a pipe, like idle server workers (size: the threads count).
+         */
+        ThreadServer
+    };
+
+    /**
+     * @param type
+     * @param size  The heap size of LargeHeap, or the threads count of ThreadServer.
+     */
+    explicit Fixture(Type type, size_t size = 0);
+    ~Fixture();
+
+    Fixture(const Fixture &) = delete;
+    Fixture &operator =(const Fixture &) = delete;
+
+    Process::ProcessID getProcessID() const { return processID; }
+    Process::MemoryAddress getAddress() const { return address; }
+    size_t getSize() const { return size; }
+
+private:
+    struct ReadyMessage{
+        Process::MemoryAddress address;
+        size_t size;
+    };
+
+    static void runChild(Type type, size_t size, int readyDescriptor);
+
+    Process::ProcessID processID;
+    Process::MemoryAddress address = 0;
+    size_t size = 0;
+};
+
+#endif // FIXTURES_H
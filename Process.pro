@@ -1,3 +1,8 @@
 TEMPLATE = subdirs
 
-SUBDIRS += Source
+SUBDIRS += Source \
+    Benchmark \
+    Tests
+
+Benchmark.depends = Source
+Tests.depends = Source
@@ -4,11 +4,33 @@ INCLUDEPATH += .
 
 CONFIG += console
 CONFIG += c++11
+CONFIG += thread
 CONFIG -= qt
 
+# Uncomment to compile the instrumentation hooks out.
+#DEFINES += PROCESS_NO_INSTRUMENTATION
+
 # Input
 HEADERS += directory.h process.h processes.h \
-    console.h
+    console.h \
+    remoteptr.h \
+    freezer.h \
+    varint.h \
+    syscalllog.h \
+    syscallrecorder.h \
+    instrumentation.h \
+    threadgroup.h \
+    memorymap.h \
+    heapwalker.h \
+    memoryindex.h
 SOURCES += directory.cpp process.cpp processes.cpp \
     processconsole.cpp \
-    console.cpp
+    console.cpp \
+    freezer.cpp \
+    syscalllog.cpp \
+    syscallrecorder.cpp \
+    instrumentation.cpp \
+    threadgroup.cpp \
+    memorymap.cpp \
+    heapwalker.cpp \
+    memoryindex.cpp
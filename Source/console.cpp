@@ -25,7 +25,24 @@
 
 #include "console.h"
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+thread_local std::string *Console::currentOutput = nullptr;
 
 Console::Console()
     : notFoundHandler(defaultNotFoundHandler)
@@ -45,6 +62,11 @@ void Console::run() {
     }
 }
 
+void Console::setOptionNotFoundHandler(const NotFoundHandlerType &handler)
+{
+    notFoundHandler = handler;
+}
+
 std::string Console::readWord() {
     std::string tmp;
 
@@ -56,24 +78,179 @@ std::string Console::readWord() {
 void Console::addOption(const std::string &optionName, uint8_t argumentsNumber, const OptionHandler &optionHandler)
 {
     mOptions[optionName] = OptionEntry{ argumentsNumber, optionHandler };
+
+    hashTableValid = false;
 }
 
 void Console::processOption() {
     const auto word = readWord();
 
-    if(mOptions.count(word) == 0)
+    // The input ended, there's nothing more to do.
+    if(word.empty() && !std::cin) {
+        stop();
+
+        return;
+    }
+
+    const auto option = findOption(word.data(), word.size());
+
+    if(option == nullptr) {
         notFoundHandler(word);
 
+        return;
+    }
+
     std::list<std::string> stringList;
     stringList.push_back(word);
 
     // Read the required args.
-    for(uint8_t i = 0; i < mOptions.at(word).argumentsNumber; ++i)
+    for(uint8_t i = 0; i < option->second.argumentsNumber; ++i)
     {
         stringList.push_back(readWord());
     }
 
-    mOptions.at(word).optionHandler(stringList);
+    option->second.optionHandler(stringList);
+}
+
+void Console::runScript(const std::string &path)
+{
+    const int fileDescriptor = ::open(path.c_str(), O_RDONLY);
+
+    if(fileDescriptor < 0)
+        throw std::invalid_argument("runScript: can't open " + path);
+
+    struct stat status;
+
+    if(::fstat(fileDescriptor, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+        void *mapping = ::mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+
+        if(mapping != MAP_FAILED) {
+            ::madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+
+            const char *begin = static_cast<const char *>(mapping);
+
+            processBuffer(begin, begin + status.st_size, true);
+
+            ::munmap(mapping, status.st_size);
+            ::close(fileDescriptor);
+
+            return;
+        }
+    }
+
+    runBatch(fileDescriptor);
+
+    ::close(fileDescriptor);
+}
+
+void Console::runBatch(int fileDescriptor)
+{
+    std::vector<char> buffer(64*1024);
+    size_t bufferedBytes = 0;
+    bool endOfInput = false;
+
+    while(!endOfInput && stopFlag == false) {
+        // A single command bigger than the whole buffer.
+        if(bufferedBytes == buffer.size())
+            buffer.resize(buffer.size() * 2);
+
+        const ssize_t bytesRead = ::read(fileDescriptor, buffer.data() + bufferedBytes, buffer.size() - bufferedBytes);
+
+        if(bytesRead < 0) {
+            if(errno == EINTR)
+                continue;
+
+            throw std::runtime_error("runBatch: read() failed");
+        }
+
+        endOfInput = bytesRead == 0;
+        bufferedBytes += bytesRead;
+
+        const size_t consumedBytes = processBuffer(buffer.data(), buffer.data() + bufferedBytes, endOfInput);
+
+        // Keep the incomplete command for the next read.
+        std::memmove(buffer.data(), buffer.data() + consumedBytes, bufferedBytes - consumedBytes);
+        bufferedBytes -= consumedBytes;
+    }
+}
+
+size_t Console::processBuffer(const char *begin, const char *end, bool endOfInput)
+{
+    // A handler that runs commands itself (runScript()) mustn't overwrite the caller's arguments.
+    std::list<std::string> nestedArguments, nestedSpareArguments;
+    const bool nested = mArgumentsInUse;
+    std::list<std::string> &arguments = nested ? nestedArguments : mArguments;
+    std::list<std::string> &spareArguments = nested ? nestedSpareArguments : mSpareArguments;
+
+    struct InUseGuard{
+        bool &inUse;
+        const bool previous;
+
+        ~InUseGuard() { inUse = previous; }
+    } inUseGuard{mArgumentsInUse, mArgumentsInUse};
+
+    mArgumentsInUse = true;
+
+    const char *position = begin;
+
+    while(stopFlag == false) {
+        const char *commandStart = position;
+        Token name;
+
+        if(!nextToken(position, end, name))
+            return end - begin;
+
+        // The word may go on in the next block.
+        if(position == end && !endOfInput)
+            return commandStart - begin;
+
+        const auto option = findOption(name.data, name.size);
+
+        if(option == nullptr) {
+            notFoundHandler(std::string(name.data, name.size));
+
+            continue;
+        }
+
+        const uint8_t argumentsNumber = option->second.argumentsNumber;
+
+        resizeArguments(arguments, spareArguments, argumentsNumber + 1);
+
+        auto argument = arguments.begin();
+        argument->assign(name.data, name.size);
+
+        for(uint8_t i = 0; i < argumentsNumber; ++i) {
+            Token token;
+
+            if(!nextToken(position, end, token) || (position == end && !endOfInput)) {
+                if(!endOfInput)
+                    return commandStart - begin;
+
+                write("The option " + option->first + " is missing arguments");
+
+                return end - begin;
+            }
+
+            (++argument)->assign(token.data, token.size);
+        }
+
+        option->second.optionHandler(arguments);
+    }
+
+    return position - begin;
+}
+
+void Console::resizeArguments(std::list<std::string> &arguments, std::list<std::string> &spare, size_t count)
+{
+    while(arguments.size() > count)
+        spare.splice(spare.begin(), arguments, std::prev(arguments.end()));
+
+    while(arguments.size() < count) {
+        if(spare.empty())
+            arguments.emplace_back();
+        else
+            arguments.splice(arguments.end(), spare, spare.begin());
+    }
 }
 
 void Console::defaultNotFoundHandler(const std::string &optionName) {
@@ -82,4 +259,316 @@ void Console::defaultNotFoundHandler(const std::string &optionName) {
     write(message);
 }
 
+void Console::write(const std::string &string)
+{
+    if(currentOutput != nullptr) {
+        currentOutput->append(string);
+        currentOutput->push_back('\n');
+
+        return;
+    }
+
+    std::cout << string << std::endl;
+}
+
+void Console::serve(const std::string &socketPath)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    if(socketPath.size() >= sizeof(address.sun_path))
+        throw std::invalid_argument("serve: the socket path is too long");
+
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size()+1);
+
+    const int listenDescriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if(listenDescriptor < 0)
+        throw std::runtime_error(std::string("serve: socket() failed: ") + std::strerror(errno));
+
+    ::unlink(socketPath.c_str());
+
+    if(::bind(listenDescriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(listenDescriptor, SOMAXCONN) < 0) {
+        const int error = errno;
+
+        ::close(listenDescriptor);
+
+        throw std::runtime_error("serve: can't listen on " + socketPath + ": " + std::strerror(error));
+    }
+
+    const int epollDescriptor = ::epoll_create1(EPOLL_CLOEXEC);
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listenDescriptor;
+
+    if(epollDescriptor < 0 || ::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, listenDescriptor, &event) < 0) {
+        const std::string message = std::string("serve: ") + (epollDescriptor < 0 ? "epoll_create1()" : "epoll_ctl()") +
+                " failed: " + std::strerror(errno);
+
+        if(epollDescriptor >= 0)
+            ::close(epollDescriptor);
+
+        ::close(listenDescriptor);
+        ::unlink(socketPath.c_str());
+
+        throw std::runtime_error(message);
+    }
+
+    std::map<int, Connection> connections;
+    epoll_event events[64];
+
+    stopFlag = false;
+
+    while(stopFlag == false) {
+        // Wake up now and then, a handler outside of the loop may have called stop().
+        const int eventsCount = ::epoll_wait(epollDescriptor, events, 64, 100);
+
+        for(int i = 0; i < eventsCount && stopFlag == false; ++i) {
+            const int descriptor = events[i].data.fd;
+
+            if(descriptor == listenDescriptor) {
+                acceptConnections(epollDescriptor, listenDescriptor);
+
+                continue;
+            }
+
+            auto connection = connections.find(descriptor);
+
+            if(connection == connections.end())
+                connection = connections.insert(std::make_pair(descriptor, Connection())).first;
+
+            if(!serveConnection(epollDescriptor, descriptor, connection->second, events[i].events)) {
+                ::close(descriptor);
+
+                connections.erase(connection);
+            }
+        }
+    }
+
+    // The last command (stop, most likely) may have left output behind: send what the sockets take without waiting.
+    for(auto &connection : connections) {
+        sendOutput(connection.first, connection.second);
+
+        ::close(connection.first);
+    }
+
+    ::close(epollDescriptor);
+    ::close(listenDescriptor);
+    ::unlink(socketPath.c_str());
+}
+
+void Console::acceptConnections(int epollDescriptor, int listenDescriptor)
+{
+    while(true) {
+        const int connectionDescriptor = ::accept4(listenDescriptor, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if(connectionDescriptor < 0)
+            return;
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = connectionDescriptor;
+
+        if(::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, connectionDescriptor, &event) < 0)
+            ::close(connectionDescriptor);
+    }
+}
+
+bool Console::serveConnection(int epollDescriptor, int connectionDescriptor, Connection &connection, uint32_t events)
+{
+    if(events & EPOLLERR)
+        return false;
+
+    if(connection.reading && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+        size_t bufferedBytes = connection.input.size();
+        const size_t readLimit = bufferedBytes + 256*1024;
+
+        // Level triggered: whatever is left over the limit is read on the next round, after the other clients.
+        while(bufferedBytes < readLimit) {
+            connection.input.resize(bufferedBytes + 16*1024);
+
+            const ssize_t bytesRead = ::read(connectionDescriptor, connection.input.data() + bufferedBytes, 16*1024);
+
+            if(bytesRead > 0) {
+                bufferedBytes += bytesRead;
+
+                continue;
+            }
+
+            if(bytesRead == 0) {
+                connection.endOfInput = true;
+
+                break;
+            }
+
+            if(errno == EINTR)
+                continue;
+
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            return false;
+        }
+
+        connection.input.resize(bufferedBytes);
+
+        // Run the complete commands; their output goes to this client.
+        currentOutput = &connection.output;
+
+        const size_t consumedBytes = processBuffer(connection.input.data(), connection.input.data() + bufferedBytes, connection.endOfInput);
+
+        currentOutput = nullptr;
+
+        connection.input.erase(connection.input.begin(), connection.input.begin() + consumedBytes);
+
+        // What's left is one incomplete command; a client that makes it grow forever is dropped.
+        if(connection.input.size() > maximumPendingInput)
+            return false;
+    }
+
+    // Send as much as the socket takes now, the rest when it's writable again.
+    if(!sendOutput(connectionDescriptor, connection))
+        return false;
+
+    const bool pendingOutput = !connection.output.empty();
+
+    if(connection.endOfInput && !pendingOutput)
+        return false;
+
+    // A client that doesn't read its output doesn't get to send more commands.
+    connection.reading = !connection.endOfInput && connection.output.size() - connection.outputOffset < maximumPendingOutput;
+
+    epoll_event event{};
+    event.data.fd = connectionDescriptor;
+
+    if(connection.reading)
+        event.events |= EPOLLIN | EPOLLRDHUP;
+
+    if(pendingOutput)
+        event.events |= EPOLLOUT;
+
+    return ::epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, connectionDescriptor, &event) == 0;
+}
+
+bool Console::sendOutput(int connectionDescriptor, Connection &connection)
+{
+    while(connection.outputOffset < connection.output.size()) {
+        const ssize_t bytesSent = ::send(connectionDescriptor, connection.output.data() + connection.outputOffset,
+                                         connection.output.size() - connection.outputOffset, MSG_NOSIGNAL);
 
+        if(bytesSent < 0) {
+            if(errno == EINTR)
+                continue;
+
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                return false;
+
+            break;
+        }
+
+        connection.outputOffset += bytesSent;
+    }
+
+    if(connection.outputOffset == connection.output.size()) {
+        connection.output.clear();
+        connection.outputOffset = 0;
+    }
+
+    return true;
+}
+
+bool Console::nextToken(const char *&position, const char *end, Token &token)
+{
+    while(position < end && std::isspace(static_cast<unsigned char>(*position)))
+        ++position;
+
+    if(position == end)
+        return false;
+
+    token.data = position;
+
+    while(position < end && !std::isspace(static_cast<unsigned char>(*position)))
+        ++position;
+
+    token.size = position - token.data;
+
+    return true;
+}
+
+const Console::OptionMap::value_type *Console::findOption(const char *name, size_t size)
+{
+    if(!hashTableValid)
+        buildHashTable();
+
+    if(mHashTable.empty())
+        return nullptr;
+
+    const auto option = mHashTable[hash(name, size, hashSeed) & (mHashTable.size()-1)];
+
+    if(option == nullptr || option->first.size() != size || std::memcmp(option->first.data(), name, size) != 0)
+        return nullptr;
+
+    return option;
+}
+
+void Console::buildHashTable()
+{
+    size_t tableSize = 1;
+
+    while(tableSize < mOptions.size() * 2)
+        tableSize <<= 1;
+
+    while(true) {
+        for(uint32_t seed = 0; seed < 256; ++seed) {
+            mHashTable.assign(tableSize, nullptr);
+
+            bool collision = false;
+
+            for(const auto &option : mOptions) {
+                auto &slot = mHashTable[hash(option.first.data(), option.first.size(), seed) & (tableSize-1)];
+
+                if(slot != nullptr) {
+                    collision = true;
+
+                    break;
+                }
+
+                slot = &option;
+            }
+
+            if(!collision) {
+                hashSeed = seed;
+                hashTableValid = true;
+
+                // Create the argument nodes for the largest arity up front.
+                uint8_t largestArity = 0;
+
+                for(const auto &option : mOptions)
+                    largestArity = std::max(largestArity, option.second.argumentsNumber);
+
+                const size_t nodes = mArguments.size() + mSpareArguments.size();
+
+                if(nodes < size_t(largestArity) + 1)
+                    mSpareArguments.resize(mSpareArguments.size() + largestArity + 1 - nodes);
+
+                return;
+            }
+        }
+
+        tableSize <<= 1;
+    }
+}
+
+uint32_t Console::hash(const char *data, size_t size, uint32_t seed)
+{
+    // FNV-1a, seeded.
+    uint32_t value = 2166136261u ^ (seed * 16777619u);
+
+    for(size_t i = 0; i < size; ++i) {
+        value ^= static_cast<unsigned char>(data[i]);
+        value *= 16777619u;
+    }
+
+    return value ^ (value >> 15);
+}
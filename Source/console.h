@@ -26,6 +26,8 @@
 #ifndef CONSOLE_H
 #define CONSOLE_H
 
+#include <atomic>
+
 #include <iostream>
 
 #include <map>
@@ -34,6 +36,10 @@
 
 #include <functional>
 
+#include <vector>
+
+#include <cstdint>
+
 class Console
 {
 public:
@@ -63,18 +69,130 @@ public:
      */
     void processOption();
 
+    /**
+     * @brief runScript  Run the commands of a file (or a pipe), as if they were typed.
+     * Regular files are mapped, other files are read in large blocks.
+     * A handler may call it, e.g. to source a script; see processBuffer().
+     * @param path
+     */
+    void runScript(const std::string &path);
+
+    /**
+     * @brief runBatch  Run the commands read from @arg fileDescriptor until its end, or stop().
+     * @param fileDescriptor
+     */
+    void runBatch(int fileDescriptor);
+
+    /**
+     * @brief processBuffer  Run every complete command in [@arg begin, @arg end).
+     * @param endOfInput  Nothing follows the buffer, so the last word is complete.
+     * @return The number of bytes consumed; the rest is the start of an incomplete command.
+     * Reentrant: a call from inside a handler parses into its own arguments, so the caller's stay intact.
+     */
+    size_t processBuffer(const char *begin, const char *end, bool endOfInput);
+
+    /**
+     * @brief serve  Serve clients on a Unix domain socket until stop().
+     * Every client sends commands as on the standard input, and gets what the handlers write().
+     * All the handlers run on the calling thread, one command at a time, so they share the session safely.
+     * @param socketPath  Created (and removed at the end) by serve().
+     */
+    void serve(const std::string &socketPath);
+
+    /**
+     * @brief maximumPendingOutput  Stop reading a client's commands while it has more unread output than this.
+     */
+    static const size_t maximumPendingOutput = 1024*1024;
+
+    /**
+     * @brief maximumPendingInput  Close a client whose incomplete command grows bigger than this.
+     */
+    static const size_t maximumPendingInput = 1024*1024;
+
 private:
     struct OptionEntry{
         uint8_t argumentsNumber;
         OptionHandler optionHandler;
     };
 
+    typedef std::map<std::string, OptionEntry> OptionMap;
+
+    /**
+     * @brief The Token struct  A word inside the input buffer (not owned).
+     */
+    struct Token{
+        const char *data;
+        size_t size;
+    };
+
+    struct Connection{
+        std::vector<char> input;
+        std::string output;
+        size_t outputOffset = 0;
+        bool endOfInput = false;
+        bool reading = true;
+    };
+
     static void defaultNotFoundHandler(const std::string &optionName);
 
-    std::map<std::string, OptionEntry> mOptions;
+    void acceptConnections(int epollDescriptor, int listenDescriptor);
+
+    /**
+     * @brief serveConnection  Read what's ready, run the complete commands and send what's possible.
+     * @return false if the connection is done and should be closed.
+     */
+    bool serveConnection(int epollDescriptor, int connectionDescriptor, Connection &connection, uint32_t events);
+
+    /**
+     * @brief sendOutput  Send the pending output of @arg connection, as much as the socket takes without blocking.
+     * @return false if the connection failed.
+     */
+    static bool sendOutput(int connectionDescriptor, Connection &connection);
+
+    /**
+     * @brief currentOutput  Where write() goes: the output of the client whose command is running on this thread,
+     * or the standard output.
+     */
+    static thread_local std::string *currentOutput;
+
+    static bool nextToken(const char *&position, const char *end, Token &token);
+
+    /**
+     * @brief findOption  Look an option up in the perfect hash table.
+     * @return nullptr if there's no such option.
+     */
+    const OptionMap::value_type *findOption(const char *name, size_t size);
+
+    /**
+     * @brief buildHashTable  Find a seed for which every option gets its own slot.
+     */
+    void buildHashTable();
+
+    /**
+     * @brief resizeArguments  Make @arg arguments hold @arg count strings, moving nodes from and to @arg spare.
+     * Nodes are allocated only when @arg spare runs out.
+     */
+    static void resizeArguments(std::list<std::string> &arguments, std::list<std::string> &spare, size_t count);
+
+    static uint32_t hash(const char *data, size_t size, uint32_t seed);
+
+    OptionMap mOptions;
     NotFoundHandlerType notFoundHandler;
 
-    bool stopFlag = false;
+    std::vector<const OptionMap::value_type *> mHashTable;
+    uint32_t hashSeed = 0;
+    bool hashTableValid = false;
+
+    // Reused between commands. buildHashTable() creates the nodes for the largest arity,
+    // and switching arity moves nodes to and from mSpareArguments, so dispatching doesn't allocate.
+    std::list<std::string> mArguments;
+    std::list<std::string> mSpareArguments;
+
+    // Set while processBuffer() dispatches from mArguments; a nested call uses local lists instead.
+    bool mArgumentsInUse = false;
+
+    // stop() may come from another thread while serve() runs.
+    std::atomic<bool> stopFlag{false};
 };
 
 #endif // CONSOLE_H
@@ -30,13 +30,21 @@
 Directory::Directory(const std::string &directoryPath)
 {
     mPDir = opendir(directoryPath.c_str());
+
+    if(mPDir == nullptr)
+        throw std::invalid_argument("Directory: can't open " + directoryPath);
+}
+
+Directory::~Directory()
+{
+    closedir(mPDir);
 }
 
 std::list<dirent> Directory::getFiles() {
     dirent *directoryEntry = nullptr;
     std::list<dirent> files;
 
-    while((directoryEntry = readdir(mPDir)) > 0)
+    while((directoryEntry = readdir(mPDir)) != nullptr)
     {
         files.push_front(*directoryEntry);
     }
@@ -47,7 +55,7 @@ std::list<dirent> Directory::getFiles() {
 dirent Directory::find(const std::string &entryName) {
     dirent *directoryEntry = nullptr;
 
-    while((directoryEntry = readdir(mPDir)) > 0) {
+    while((directoryEntry = readdir(mPDir)) != nullptr) {
         if(entryName == directoryEntry->d_name)
             return *directoryEntry;
     }
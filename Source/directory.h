@@ -40,6 +40,10 @@ class Directory
 {
 public:
     Directory(const std::string &directoryPath);
+    ~Directory();
+
+    Directory(const Directory &) = delete;
+    Directory &operator =(const Directory &) = delete;
 
     std::list<dirent> getFiles();
 
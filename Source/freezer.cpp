@@ -0,0 +1,263 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#include "freezer.h"
+#include "memorymap.h"
+
+#include <climits>
+#include <stdexcept>
+
+const Freezer::Clock::duration Freezer::coalescingWindow = std::chrono::milliseconds(1);
+
+Freezer::Freezer(Process &process)
+    : Freezer(process.getProcessID())
+{
+}
+
+Freezer::Freezer(Process::ProcessID processID)
+    : processID(processID), mStatistics(), runningTime(Clock::duration::zero())
+{
+}
+
+Freezer::~Freezer()
+{
+    stop();
+}
+
+Freezer::EntryID Freezer::freeze(Process::MemoryAddress address, const std::vector<Process::Byte> &bytes, std::chrono::milliseconds interval)
+{
+    if(bytes.empty())
+        throw std::invalid_argument("freeze: no bytes to write");
+
+    if(interval <= std::chrono::milliseconds::zero())
+        throw std::invalid_argument("freeze: the interval must be positive");
+
+    // process_vm_writev() respects the page protection, so an entry on a read-only page would fail every tick.
+    const MemoryMap memoryMap(processID);
+    const uint64_t end = static_cast<uint64_t>(address) + bytes.size();
+
+    for(uint64_t position = static_cast<uint64_t>(address); position < end; ) {
+        const MemoryMap::Region *region = memoryMap.find(static_cast<Process::MemoryAddress>(position));
+
+        if(region == nullptr || !region->writable)
+            throw std::invalid_argument("freeze: the address isn't in a writable mapping");
+
+        position = static_cast<uint64_t>(region->end);
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    EntryID entryID = nextEntryID++;
+
+    // Due now: the value is pinned on the next tick.
+    mEntries.insert(std::make_pair(address, Entry{ entryID, bytes, interval, Clock::now() }));
+
+    mCondition.notify_one();
+
+    return entryID;
+}
+
+void Freezer::unfreeze(EntryID entryID)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for(auto iterator = mEntries.begin(); iterator != mEntries.end(); ++iterator) {
+        if(iterator->second.entryID == entryID) {
+            mEntries.erase(iterator);
+
+            return;
+        }
+    }
+
+    throw std::invalid_argument("unfreeze: Not Found");
+}
+
+void Freezer::start()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if(stopFlag == false)
+        return;
+
+    stopFlag = false;
+    startTime = Clock::now();
+
+    mThread = std::thread(&Freezer::run, this);
+}
+
+void Freezer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        if(stopFlag)
+            return;
+
+        stopFlag = true;
+        runningTime += Clock::now() - startTime;
+    }
+
+    mCondition.notify_one();
+    mThread.join();
+}
+
+Freezer::Statistics Freezer::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Statistics statistics = mStatistics;
+
+    auto elapsed = runningTime;
+
+    if(stopFlag == false)
+        elapsed += Clock::now() - startTime;
+
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+
+    statistics.averageJitter = statistics.ticks ? totalJitter / statistics.ticks : 0;
+    statistics.entriesPerSecond = seconds > 0 ? statistics.entriesWritten / seconds : 0;
+
+    return statistics;
+}
+
+void Freezer::run()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while(stopFlag == false) {
+        const auto now = Clock::now();
+        const auto nextDue = writeDue(now, now + coalescingWindow);
+
+        if(nextDue == Clock::time_point::max())
+            mCondition.wait(lock);
+        else
+            mCondition.wait_until(lock, nextDue);
+    }
+}
+
+Freezer::Clock::time_point Freezer::writeDue(Clock::time_point now, Clock::time_point deadline)
+{
+    std::vector<EntryTable::const_iterator> pending;
+    Clock::time_point earliestDue = Clock::time_point::max();
+    Clock::time_point nextDue = Clock::time_point::max();
+
+    for(auto iterator = mEntries.begin(); iterator != mEntries.end(); ++iterator) {
+        Entry &entry = iterator->second;
+
+        if(entry.due <= deadline) {
+            earliestDue = std::min(earliestDue, entry.due);
+
+            pending.push_back(iterator);
+
+            // Don't try to catch up on missed ticks, just keep the interval from now.
+            entry.due += entry.interval;
+
+            if(entry.due <= now)
+                entry.due = now + entry.interval;
+        }
+
+        nextDue = std::min(nextDue, entry.due);
+    }
+
+    if(pending.empty())
+        return nextDue;
+
+    if(now > earliestDue) {
+        const double jitter = std::chrono::duration<double, std::micro>(now - earliestDue).count();
+
+        totalJitter += jitter;
+        mStatistics.maximumJitter = std::max(mStatistics.maximumJitter, jitter);
+    }
+
+    ++mStatistics.ticks;
+
+    flush(pending);
+
+    return nextDue;
+}
+
+void Freezer::flush(std::vector<EntryTable::const_iterator> &pending)
+{
+    std::vector<iovec> localVector;
+    std::vector<iovec> remoteVector;
+
+    auto first = pending.begin();
+
+    while(first != pending.end()) {
+        localVector.clear();
+        remoteVector.clear();
+
+        size_t bytesCount = 0;
+        auto last = first;
+
+        // Both vectors are limited to IOV_MAX entries per call.
+        for(; last != pending.end() && localVector.size() < IOV_MAX; ++last) {
+            const Process::MemoryAddress address = (*last)->first;
+            const Entry &entry = (*last)->second;
+
+            localVector.push_back(iovec{ const_cast<Process::Byte *>(entry.bytes.data()), entry.bytes.size() });
+
+            // Entries that continue each other (same page, usually the same struct) share one remote iovec.
+            if(!remoteVector.empty() &&
+                    reinterpret_cast<Process::MemoryAddress>(remoteVector.back().iov_base) + static_cast<Process::MemoryAddress>(remoteVector.back().iov_len) == address)
+                remoteVector.back().iov_len += entry.bytes.size();
+            else
+                remoteVector.push_back(iovec{ reinterpret_cast<void *>(address), entry.bytes.size() });
+
+            bytesCount += entry.bytes.size();
+        }
+
+        ssize_t bytesWritten = ::process_vm_writev(processID, localVector.data(), localVector.size(), remoteVector.data(), remoteVector.size(), 0);
+
+        ++mStatistics.writeCalls;
+
+        if(bytesWritten == static_cast<ssize_t>(bytesCount)) {
+            mStatistics.entriesWritten += localVector.size();
+            mStatistics.bytesWritten += bytesCount;
+        }
+        else {
+            // Some address isn't writable; find out which entries still work.
+            for(auto iterator = first; iterator != last; ++iterator) {
+                const Entry &entry = (*iterator)->second;
+
+                ++mStatistics.writeCalls;
+
+                if(Process::writeMemory(processID, (*iterator)->first, entry.bytes.data(), entry.bytes.size()) == static_cast<ssize_t>(entry.bytes.size())) {
+                    ++mStatistics.entriesWritten;
+                    mStatistics.bytesWritten += entry.bytes.size();
+                }
+                else {
+                    ++mStatistics.failedEntries;
+
+                    // The page went away or became read-only after freeze() checked it.
+                    mEntries.erase(*iterator);
+                }
+            }
+        }
+
+        first = last;
+    }
+}
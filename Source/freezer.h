@@ -0,0 +1,155 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#ifndef FREEZER_H
+#define FREEZER_H
+
+#include "process.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/uio.h>
+
+/**
+ * @brief The Freezer class  Pin variables of a running process to fixed values.
+ * A background thread re-writes every due entry with one vectored process_vm_writev() per tick,
+ * without stopping the process.
+ */
+class Freezer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef unsigned int EntryID;
+
+    struct Statistics
+    {
+        uint64_t ticks;
+        uint64_t writeCalls;
+        uint64_t entriesWritten;
+        uint64_t bytesWritten;
+        /**
+         * @brief failedEntries  Entries dropped because their address stopped being writable.
+         */
+        uint64_t failedEntries;
+
+        /**
+         * @brief averageJitter  How late the ticks woke up relative to their due time, in microseconds.
+         */
+        double averageJitter;
+        double maximumJitter;
+
+        double entriesPerSecond;
+    };
+
+    explicit Freezer(Process &process);
+    explicit Freezer(Process::ProcessID processID);
+
+    ~Freezer();
+
+    /**
+     * @brief freeze  Write @arg bytes at @arg address every @arg interval, until unfreeze().
+     * The writer doesn't stop the process, so it can't poke read-only pages;
+     * throws std::invalid_argument if the bytes aren't all in writable mappings.
+     * An entry whose page stops being writable later (munmap, mprotect) is dropped on its first failed write.
+     * @return An ID for unfreeze().
+     */
+    EntryID freeze(Process::MemoryAddress address, const std::vector<Process::Byte> &bytes, std::chrono::milliseconds interval);
+
+    template<typename T>
+    EntryID freeze(Process::MemoryAddress address, const T &value, std::chrono::milliseconds interval) {
+        const Process::Byte *bytes = reinterpret_cast<const Process::Byte *>(&value);
+
+        return freeze(address, std::vector<Process::Byte>(bytes, bytes + sizeof(T)), interval);
+    }
+
+    void unfreeze(EntryID entryID);
+
+    /**
+     * @brief start  Start the writer thread.
+     */
+    void start();
+
+    /**
+     * @brief stop  Stop the writer thread (entries are kept).
+     */
+    void stop();
+
+    Statistics getStatistics() const;
+
+    /**
+     * @brief coalescingWindow  Entries due within this window of each other are written in the same tick.
+     */
+    static const Clock::duration coalescingWindow;
+
+private:
+    struct Entry
+    {
+        EntryID entryID;
+        std::vector<Process::Byte> bytes;
+        Clock::duration interval;
+        Clock::time_point due;
+    };
+
+    typedef std::multimap<Process::MemoryAddress, Entry> EntryTable;
+
+    void run();
+
+    /**
+     * @brief writeDue  Write every entry due before @arg deadline.
+     * @return The next due time.
+     */
+    Clock::time_point writeDue(Clock::time_point now, Clock::time_point deadline);
+
+    /**
+     * @brief flush  Write the pending entries with one process_vm_writev(), or one by one if it falls short.
+     * Entries that can't be written are erased, so they don't fail again every tick.
+     */
+    void flush(std::vector<EntryTable::const_iterator> &pending);
+
+    Process::ProcessID processID;
+
+    // Ordered by address, so the entries of a page are next to each other and contiguous entries merge into one iovec.
+    EntryTable mEntries;
+    EntryID nextEntryID = 0;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::thread mThread;
+    bool stopFlag = true;
+
+    Statistics mStatistics;
+    double totalJitter = 0;
+    Clock::time_point startTime;
+    Clock::duration runningTime;
+};
+
+#endif // FREEZER_H
@@ -0,0 +1,605 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#include "heapwalker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+
+const size_t wordSize = sizeof(Process::Register);
+const size_t chunkHeaderSize = 2 * wordSize;
+const size_t minimumChunkSize = 4 * wordSize;
+const size_t mallocAlignment = 2 * wordSize;
+
+/**
+ * @brief heapInfoSize  sizeof(heap_info): ar_ptr, prev, size and mprotect_size.
+ */
+const size_t heapInfoSize = 4 * wordSize;
+
+/**
+ * @brief heapMaximumSize  HEAP_MAX_SIZE (2 * DEFAULT_MMAP_THRESHOLD_MAX): thread heaps are aligned on it.
+ */
+const size_t heapMaximumSize = 2 * 4 * 1024 * 1024 * sizeof(long);
+
+const size_t smallClassesLimit = 1024;
+const size_t smallClassesCount = (smallClassesLimit - minimumChunkSize) / mallocAlignment + 1;
+const size_t sizeClassesCount = smallClassesCount + 48;
+
+const uint64_t prevInUseBit = 1;
+const uint64_t isMmappedBit = 2;
+const uint64_t sizeBitsMask = 7;
+
+// Follow an arena list at most this far.
+const unsigned int maximumArenas = 1024;
+
+uint64_t loadWord(const uint8_t *position)
+{
+    Process::Register word;
+
+    std::memcpy(&word, position, sizeof(word));
+
+    return word;
+}
+
+Process::MemoryAddress alignUp(Process::MemoryAddress address)
+{
+    return (address + mallocAlignment - 1) & ~static_cast<Process::MemoryAddress>(mallocAlignment - 1);
+}
+
+}
+
+#ifdef __x86_64__
+const HeapWalker::ArenaLayout HeapWalker::arenaLayouts[2] = {
+    { 96, 2160, 2200 },     // glibc >= 2.27 (have_fastchunks)
+    { 88, 2152, 2192 },
+};
+#elif defined __i386__
+const HeapWalker::ArenaLayout HeapWalker::arenaLayouts[2] = {
+    { 56, 1096, 1116 },
+    { 52, 1092, 1112 },
+};
+#else
+# error "Your arch is not supported by Process"
+#endif
+
+double HeapWalker::ArenaReport::fragmentation() const
+{
+    const uint64_t bytes = inUseBytes + freeBytes;
+
+    return bytes ? static_cast<double>(freeBytes) / bytes : 0;
+}
+
+double HeapWalker::ArenaReport::externalFragmentation() const
+{
+    return freeBytes ? 1 - static_cast<double>(largestFreeChunk) / freeBytes : 0;
+}
+
+void HeapWalker::ArenaReport::add(const ArenaReport &another)
+{
+    segments += another.segments;
+    segmentsBytes += another.segmentsBytes;
+    inUseChunks += another.inUseChunks;
+    inUseBytes += another.inUseBytes;
+    freeChunks += another.freeChunks;
+    freeBytes += another.freeBytes;
+    largestFreeChunk = std::max(largestFreeChunk, another.largestFreeChunk);
+    topChunkBytes += another.topChunkBytes;
+    corruptSegments += another.corruptSegments;
+
+    if(sizeClasses.size() < another.sizeClasses.size())
+        sizeClasses.resize(another.sizeClasses.size());
+
+    for(size_t index = 0; index < another.sizeClasses.size(); ++index) {
+        SizeClass &sizeClass = sizeClasses[index];
+        const SizeClass &anotherClass = another.sizeClasses[index];
+
+        sizeClass.size = anotherClass.size;
+        sizeClass.inUseChunks += anotherClass.inUseChunks;
+        sizeClass.inUseBytes += anotherClass.inUseBytes;
+        sizeClass.freeChunks += anotherClass.freeChunks;
+        sizeClass.freeBytes += anotherClass.freeBytes;
+    }
+}
+
+std::string HeapWalker::Report::toText() const
+{
+    std::ostringstream stream;
+    char line[256];
+
+    auto printArena = [&](const char *name, const ArenaReport &report) {
+        std::snprintf(line, sizeof(line), "%-20s %4llu %12llu %10llu %12llu %10llu %12llu %12llu %6.1f%% %6.1f%%%s\n", name,
+                      static_cast<unsigned long long>(report.segments), static_cast<unsigned long long>(report.segmentsBytes),
+                      static_cast<unsigned long long>(report.inUseChunks), static_cast<unsigned long long>(report.inUseBytes),
+                      static_cast<unsigned long long>(report.freeChunks), static_cast<unsigned long long>(report.freeBytes),
+                      static_cast<unsigned long long>(report.topChunkBytes),
+                      report.fragmentation() * 100, report.externalFragmentation() * 100,
+                      report.corruptSegments ? " (corrupt)" : "");
+
+        stream << line;
+    };
+
+    stream << "arena                 seg        bytes     in_use in_use_bytes       free   free_bytes          top   frag  ext_frag\n";
+
+    for(const auto &arena : arenas) {
+        char name[32];
+
+        std::snprintf(name, sizeof(name), "%s%llx", arena.isMain ? "main " : "", static_cast<unsigned long long>(arena.arena));
+
+        printArena(name, arena);
+    }
+
+    printArena("mmapped", mmapped);
+    printArena("total", total);
+
+    stream << "\nsize_class     in_use in_use_bytes       free   free_bytes\n";
+
+    for(const auto &sizeClass : total.sizeClasses) {
+        if(sizeClass.inUseChunks == 0 && sizeClass.freeChunks == 0)
+            continue;
+
+        std::snprintf(line, sizeof(line), "<=%-9zu %9llu %12llu %10llu %12llu\n", sizeClass.size,
+                      static_cast<unsigned long long>(sizeClass.inUseChunks), static_cast<unsigned long long>(sizeClass.inUseBytes),
+                      static_cast<unsigned long long>(sizeClass.freeChunks), static_cast<unsigned long long>(sizeClass.freeBytes));
+
+        stream << line;
+    }
+
+    if(!topSites.empty()) {
+        stream << "\ntag                  chunks        bytes  path\n";
+
+        for(const auto &site : topSites) {
+            std::snprintf(line, sizeof(line), "%-16llx %10llu %12llu  ", static_cast<unsigned long long>(site.tag),
+                          static_cast<unsigned long long>(site.chunks), static_cast<unsigned long long>(site.bytes));
+
+            stream << line << site.path << '\n';
+        }
+    }
+
+    return stream.str();
+}
+
+HeapWalker::HeapWalker(Process::ProcessID processID)
+    : processID(processID), memoryMap(processID)
+{
+}
+
+std::vector<HeapWalker::Arena> HeapWalker::findArenas()
+{
+    std::vector<Arena> arenas;
+
+    const MemoryMap::Region *heapMapping = memoryMap.findByPath("[heap]");
+
+    Process::MemoryAddress mainArena = 0;
+
+    if(heapMapping != nullptr) {
+        // The kernel may split the brk area into several mappings (e.g. after a fork); walk them as one.
+        MemoryMap::Region heapRegion = *heapMapping;
+
+        for(const MemoryMap::Region *next = memoryMap.find(heapRegion.end); next != nullptr && next->path == "[heap]"; next = memoryMap.find(heapRegion.end))
+            heapRegion.end = next->end;
+
+        mainArena = findMainArena(heapRegion);
+
+        Arena arena{ mainArena, true, 0, {} };
+        Process::MemoryAddress end = heapRegion.end;
+
+        // The top chunk ends the main heap; it may end before the mapping does.
+        if(mainArena != 0) {
+            arena.top = readWord(mainArena + layout->topOffset);
+
+            const Process::MemoryAddress topEnd = arena.top + (readWord(arena.top + wordSize) & ~sizeBitsMask);
+
+            if(heapRegion.contains(arena.top) && topEnd <= heapRegion.end)
+                end = topEnd;
+        }
+
+        arena.segments.push_back(Segment{ heapRegion.start, end });
+
+        arenas.push_back(arena);
+    }
+
+    // The thread heaps: HEAP_MAX_SIZE aligned mappings starting with a heap_info.
+    for(const auto &region : memoryMap.getRegions()) {
+        if(region.start % heapMaximumSize != 0 || !region.readable || !region.writable || !region.path.empty())
+            continue;
+
+        uint8_t heapInfo[heapInfoSize];
+
+        if(Process::readMemory(processID, region.start, heapInfo, sizeof(heapInfo)) != sizeof(heapInfo))
+            continue;
+
+        const Process::MemoryAddress arenaAddress = loadWord(heapInfo);
+        const Process::MemoryAddress heapSize = loadWord(heapInfo + 2 * wordSize);
+
+        if(arenaAddress == 0 || heapSize < static_cast<Process::MemoryAddress>(heapInfoSize) ||
+                heapSize > static_cast<Process::MemoryAddress>(std::min(heapMaximumSize, region.size())))
+            continue;
+
+        auto arena = std::find_if(arenas.begin(), arenas.end(), [arenaAddress](const Arena &arena) {
+            return arena.address == arenaAddress;
+        });
+
+        if(arena == arenas.end()) {
+            arenas.push_back(Arena{ arenaAddress, false, 0, {} });
+            arena = arenas.end() - 1;
+
+            if(layout != nullptr)
+                arena->top = readWord(arenaAddress + layout->topOffset);
+        }
+
+        // The first heap of an arena holds the malloc_state right after the heap_info, whose padding
+        // differs between glibc versions; any arena inside this mapping marks a first heap.
+        Process::MemoryAddress start = alignUp(region.start + heapInfoSize);
+
+        if(arenaAddress > region.start && arenaAddress < region.start + heapSize)
+            start = alignUp(arenaAddress + (layout ? layout->size : arenaLayouts[0].size));
+
+        arena->segments.push_back(Segment{ start, region.start + heapSize });
+    }
+
+    return arenas;
+}
+
+HeapWalker::Report HeapWalker::walk(size_t topSitesCount)
+{
+    const std::vector<Arena> arenas = findArenas();
+
+    Report report;
+
+    report.arenas.resize(arenas.size());
+    report.total = ArenaReport();
+
+    std::vector<SiteMap> sites(arenas.size());
+    std::atomic<size_t> nextArena(0);
+
+    // A few workers take the arenas one by one; each holds one window of memory.
+    auto worker = [&] {
+        for(size_t index = nextArena++; index < arenas.size(); index = nextArena++)
+            walkArena(arenas[index], report.arenas[index], sites[index]);
+    };
+
+    const size_t workersCount = std::min<size_t>(arenas.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> workers;
+
+    for(size_t i = 1; i < workersCount; ++i)
+        workers.emplace_back(worker);
+
+    SiteMap mmappedSites;
+
+    // While the workers walk the arenas.
+    walkMmapped(arenas, report.mmapped, mmappedSites);
+
+    worker();
+
+    for(auto &thread : workers)
+        thread.join();
+
+    report.total.add(report.mmapped);
+
+    sites.push_back(std::move(mmappedSites));
+
+    SiteMap allSites;
+
+    for(size_t index = 0; index < sites.size(); ++index) {
+        if(index < arenas.size())
+            report.total.add(report.arenas[index]);
+
+        for(const auto &site : sites[index]) {
+            AllocationSite &total = allSites[site.first];
+
+            total.tag = site.first;
+            total.chunks += site.second.chunks;
+            total.bytes += site.second.bytes;
+        }
+    }
+
+    for(const auto &site : allSites)
+        report.topSites.push_back(site.second);
+
+    const size_t sitesCount = std::min(topSitesCount, report.topSites.size());
+
+    std::partial_sort(report.topSites.begin(), report.topSites.begin() + sitesCount, report.topSites.end(),
+                      [](const AllocationSite &first, const AllocationSite &second) {
+        return first.bytes > second.bytes;
+    });
+
+    report.topSites.resize(sitesCount);
+
+    for(auto &site : report.topSites)
+        site.path = memoryMap.find(site.tag)->path;
+
+    return report;
+}
+
+Process::MemoryAddress HeapWalker::readWord(Process::MemoryAddress address)
+{
+    Process::Register word = 0;
+
+    Process::readMemory(processID, address, &word, sizeof(word));
+
+    return word;
+}
+
+Process::MemoryAddress HeapWalker::findMainArena(const MemoryMap::Region &heapRegion)
+{
+    const auto &regions = memoryMap.getRegions();
+
+    for(size_t regionIndex = 0; regionIndex < regions.size(); ++regionIndex) {
+        const MemoryMap::Region &region = regions[regionIndex];
+
+        // main_arena is in libc's .data.
+        if(!region.writable || region.path.find("/libc") == std::string::npos)
+            continue;
+
+        std::vector<uint8_t> data(region.size());
+
+        if(Process::readMemory(processID, region.start, data.data(), data.size()) != static_cast<ssize_t>(data.size()))
+            continue;
+
+        for(size_t offset = 0; offset + wordSize <= data.size(); offset += wordSize) {
+            const Process::MemoryAddress top = loadWord(data.data() + offset);
+
+            if(!heapRegion.contains(top))
+                continue;
+
+            for(const auto &candidateLayout : arenaLayouts) {
+                if(offset < candidateLayout.topOffset)
+                    continue;
+
+                const Process::MemoryAddress arena = region.start + offset - candidateLayout.topOffset;
+
+                // The top chunk ends the heap, and the arenas list is a ring going through the candidate.
+                const Process::MemoryAddress topEnd = top + (readWord(top + wordSize) & ~sizeBitsMask);
+
+                if(topEnd > heapRegion.end || topEnd + 0x1000 < heapRegion.end)
+                    continue;
+
+                Process::MemoryAddress next = readWord(arena + candidateLayout.nextOffset);
+
+                for(unsigned int hops = 0; next != arena && next != 0 && hops < maximumArenas; ++hops)
+                    next = readWord(next + candidateLayout.nextOffset);
+
+                if(next == arena) {
+                    layout = &candidateLayout;
+
+                    return arena;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+void HeapWalker::walkArena(const Arena &arena, ArenaReport &report, SiteMap &sites)
+{
+    std::vector<uint8_t> window(windowSize);
+
+    report = ArenaReport();
+    report.arena = arena.address;
+    report.isMain = arena.isMain;
+    report.sizeClasses.resize(sizeClassesCount);
+
+    for(size_t index = 0; index < sizeClassesCount; ++index)
+        report.sizeClasses[index].size = sizeClassLimit(index);
+
+    for(const auto &segment : arena.segments)
+        walkSegment(segment, arena.top, window, report, sites);
+}
+
+void HeapWalker::walkSegment(const Segment &segment, Process::MemoryAddress top, std::vector<uint8_t> &window,
+                             ArenaReport &report, SiteMap &sites)
+{
+    ++report.segments;
+    report.segmentsBytes += segment.end - segment.start;
+
+    Process::MemoryAddress windowStart = 0;
+    size_t windowBytes = 0;
+
+    // A chunk is in use when the next chunk's PREV_INUSE bit says so: every chunk is counted when the next one is read.
+    bool pending = false;
+    Process::MemoryAddress pendingTag = 0;
+    size_t pendingSize = 0;
+
+    Process::MemoryAddress chunk = segment.start;
+
+    while(chunk + static_cast<Process::MemoryAddress>(chunkHeaderSize) <= segment.end) {
+        // The header and the first word of the data must be in the window.
+        if(chunk < windowStart || chunk + chunkHeaderSize + wordSize > windowStart + windowBytes) {
+            const size_t bytesToRead = std::min<size_t>(window.size(), segment.end - chunk);
+            const ssize_t bytesRead = Process::readMemory(processID, chunk, window.data(), bytesToRead);
+
+            if(bytesRead < static_cast<ssize_t>(chunkHeaderSize)) {
+                ++report.corruptSegments;
+
+                break;
+            }
+
+            windowStart = chunk;
+            windowBytes = bytesRead;
+        }
+
+        const uint8_t *header = window.data() + (chunk - windowStart);
+        const uint64_t sizeField = loadWord(header + wordSize);
+        const size_t size = sizeField & ~sizeBitsMask;
+
+        if(pending) {
+            countChunk(pendingTag, pendingSize, sizeField & prevInUseBit, report, sites);
+
+            pending = false;
+        }
+
+        if(chunk == top) {
+            report.topChunkBytes += size;
+
+            break;
+        }
+
+        // The fencepost at the end of a thread heap.
+        if(size == chunkHeaderSize)
+            break;
+
+        if(size < minimumChunkSize || size % mallocAlignment != 0 || size > static_cast<size_t>(segment.end - chunk)) {
+            ++report.corruptSegments;
+
+            break;
+        }
+
+        const bool dataInWindow = chunk + chunkHeaderSize + wordSize <= windowStart + windowBytes;
+
+        pending = true;
+        pendingTag = dataInWindow ? loadWord(header + chunkHeaderSize) : 0;
+        pendingSize = size;
+
+        chunk += size;
+    }
+
+    // The last chunk has nobody after it to tell; it's in use (free chunks would have merged into the top).
+    if(pending)
+        countChunk(pendingTag, pendingSize, true, report, sites);
+}
+
+void HeapWalker::walkMmapped(const std::vector<Arena> &arenas, ArenaReport &report, SiteMap &sites)
+{
+    report = ArenaReport();
+    report.sizeClasses.resize(sizeClassesCount);
+
+    for(size_t index = 0; index < sizeClassesCount; ++index)
+        report.sizeClasses[index].size = sizeClassLimit(index);
+
+    const Process::MemoryAddress pageSize = ::sysconf(_SC_PAGESIZE);
+
+    for(const auto &region : memoryMap.getRegions()) {
+        if(!region.readable || !region.writable || !region.path.empty())
+            continue;
+
+        // A thread heap, mapped with the same protection.
+        const bool isHeap = std::any_of(arenas.begin(), arenas.end(), [&region](const Arena &arena) {
+            return std::any_of(arena.segments.begin(), arena.segments.end(), [&region](const Segment &segment) {
+                return region.contains(segment.start);
+            });
+        });
+
+        if(isHeap)
+            continue;
+
+        bool found = false;
+
+        for(Process::MemoryAddress chunk = region.start; chunk < region.end; ) {
+            // prev_size, size and the first word of the data.
+            uint8_t header[chunkHeaderSize + wordSize];
+
+            if(Process::readMemory(processID, chunk, header, sizeof(header)) != sizeof(header))
+                break;
+
+            const uint64_t sizeField = loadWord(header + wordSize);
+            const Process::MemoryAddress size = sizeField & ~sizeBitsMask;
+
+            // mmap_chunk() sets a zero prev_size and only IS_MMAPPED, on a whole number of pages.
+            if(loadWord(header) != 0 || (sizeField & sizeBitsMask) != isMmappedBit ||
+                    size == 0 || size % pageSize != 0 || size > region.end - chunk)
+                break;
+
+            if(!found) {
+                ++report.segments;
+                report.segmentsBytes += region.size();
+
+                found = true;
+            }
+
+            countChunk(loadWord(header + chunkHeaderSize), size, true, report, sites);
+
+            chunk += size;
+        }
+    }
+}
+
+void HeapWalker::countChunk(Process::MemoryAddress tag, size_t size, bool inUse, ArenaReport &report, SiteMap &sites)
+{
+    SizeClass &sizeClass = report.sizeClasses[sizeClassIndex(size)];
+
+    if(!inUse) {
+        ++report.freeChunks;
+        report.freeBytes += size;
+        report.largestFreeChunk = std::max<uint64_t>(report.largestFreeChunk, size);
+
+        ++sizeClass.freeChunks;
+        sizeClass.freeBytes += size;
+
+        return;
+    }
+
+    ++report.inUseChunks;
+    report.inUseBytes += size;
+
+    ++sizeClass.inUseChunks;
+    sizeClass.inUseBytes += size;
+
+    if(tag == 0)
+        return;
+
+    const MemoryMap::Region *region = memoryMap.find(tag);
+
+    if(region == nullptr || region->writable || region->path.empty() || region->path[0] != '/')
+        return;
+
+    AllocationSite &site = sites[tag];
+
+    site.tag = tag;
+    ++site.chunks;
+    site.bytes += size;
+}
+
+size_t HeapWalker::sizeClassIndex(size_t size)
+{
+    if(size <= smallClassesLimit)
+        return (size - minimumChunkSize) / mallocAlignment;
+
+    // Powers of two above the small classes.
+    size_t index = smallClassesCount;
+
+    for(size_t limit = smallClassesLimit * 2; limit < size && index < sizeClassesCount-1; limit *= 2)
+        ++index;
+
+    return index;
+}
+
+size_t HeapWalker::sizeClassLimit(size_t index)
+{
+    if(index < smallClassesCount)
+        return minimumChunkSize + index * mallocAlignment;
+
+    return smallClassesLimit << (index - smallClassesCount + 1);
+}
@@ -0,0 +1,214 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#ifndef HEAPWALKER_H
+#define HEAPWALKER_H
+
+#include "memorymap.h"
+#include "process.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The HeapWalker class  Walk the glibc malloc heaps of a process (x86_64/i386 chunk layout, glibc 2.x).
+ * The arenas are found from main_arena (searched in libc's data by its top chunk pointer) and from the
+ * heap_info headers of the thread heaps. Every heap segment is read in bounded blocks, with
+ * process_vm_readv(), and its chunk headers are parsed in place; arenas are walked in parallel.
+ * @note Stop the process first (e.g. with a ThreadGroup) to get a consistent picture.
+ * @note Chunks in the tcache and the fastbins look in use to the walker, as they do to glibc.
+ * @note Chunks glibc got straight from mmap() (IS_MMAPPED, above the mmap threshold) belong to no arena: they're found
+ * at the start of the anonymous mappings and reported apart, as the "mmapped" row. Those of memalign() with a big
+ * alignment don't start their mapping, and aren't found.
+ */
+class HeapWalker
+{
+public:
+    struct Segment
+    {
+        /**
+         * @brief start  The first chunk.
+         */
+        Process::MemoryAddress start;
+        Process::MemoryAddress end;
+    };
+
+    struct Arena
+    {
+        /**
+         * @brief address  The malloc_state, or 0 if main_arena wasn't found (the [heap] is walked anyway).
+         */
+        Process::MemoryAddress address;
+        bool isMain;
+
+        /**
+         * @brief top  The top chunk, or 0 if unknown.
+         */
+        Process::MemoryAddress top;
+
+        std::vector<Segment> segments;
+    };
+
+    struct SizeClass
+    {
+        /**
+         * @brief size  The biggest chunk size in the class.
+         */
+        size_t size;
+
+        uint64_t inUseChunks;
+        uint64_t inUseBytes;
+        uint64_t freeChunks;
+        uint64_t freeBytes;
+    };
+
+    /**
+     * @brief The AllocationSite struct  glibc doesn't record who allocated a chunk. The walker groups in-use chunks by their first
+     * word when it points into a read-only part of a mapped file: a vtable or type descriptor, which identifies the allocating type.
+     */
+    struct AllocationSite
+    {
+        Process::MemoryAddress tag;
+        std::string path;
+
+        uint64_t chunks;
+        uint64_t bytes;
+    };
+
+    struct ArenaReport
+    {
+        Process::MemoryAddress arena;
+        bool isMain;
+
+        uint64_t segments;
+        uint64_t segmentsBytes;
+
+        uint64_t inUseChunks;
+        uint64_t inUseBytes;
+        uint64_t freeChunks;
+        uint64_t freeBytes;
+        uint64_t largestFreeChunk;
+        uint64_t topChunkBytes;
+
+        /**
+         * @brief corruptSegments  Segments whose walk stopped on an invalid chunk header (or an unreadable block).
+         */
+        uint64_t corruptSegments;
+
+        std::vector<SizeClass> sizeClasses;
+
+        /**
+         * @brief fragmentation  The part of the heap (top chunk excluded) that is free.
+         */
+        double fragmentation() const;
+
+        /**
+         * @brief externalFragmentation  1 - largest free chunk / free bytes: how scattered the free memory is.
+         */
+        double externalFragmentation() const;
+
+        void add(const ArenaReport &another);
+    };
+
+    struct Report
+    {
+        std::vector<ArenaReport> arenas;
+
+        /**
+         * @brief mmapped  The IS_MMAPPED chunks; every mapping they were found in counts as a segment. Part of the total.
+         */
+        ArenaReport mmapped;
+        ArenaReport total;
+        std::vector<AllocationSite> topSites;
+
+        std::string toText() const;
+    };
+
+    explicit HeapWalker(Process::ProcessID processID);
+
+    /**
+     * @brief findArenas  Find main_arena, the thread arenas and their heap segments.
+     */
+    std::vector<Arena> findArenas();
+
+    /**
+     * @brief walk  Walk all the arenas.
+     * @param topSitesCount  How many allocation sites to report, the biggest first.
+     */
+    Report walk(size_t topSitesCount = 20);
+
+    /**
+     * @brief windowSize  The block size segments are read in; each walking thread holds one block.
+     */
+    static const size_t windowSize = 1024*1024;
+
+private:
+    /**
+     * @brief The ArenaLayout struct  Offsets in malloc_state; glibc 2.27 added have_fastchunks before the fastbins.
+     */
+    struct ArenaLayout
+    {
+        size_t topOffset;
+        size_t nextOffset;
+        size_t size;
+    };
+
+    static const ArenaLayout arenaLayouts[2];
+
+    typedef std::unordered_map<Process::MemoryAddress, AllocationSite> SiteMap;
+
+    Process::MemoryAddress readWord(Process::MemoryAddress address);
+
+    /**
+     * @brief findMainArena  Look in libc's writable data for a malloc_state whose top chunk ends the [heap].
+     * @return 0 if not found.
+     */
+    Process::MemoryAddress findMainArena(const MemoryMap::Region &heapRegion);
+
+    void walkArena(const Arena &arena, ArenaReport &report, SiteMap &sites);
+
+    void walkSegment(const Segment &segment, Process::MemoryAddress top, std::vector<uint8_t> &window,
+                     ArenaReport &report, SiteMap &sites);
+
+    /**
+     * @brief walkMmapped  Count the IS_MMAPPED chunks: runs of them start the anonymous mappings no arena uses
+     * (the kernel merges neighbouring mappings).
+     */
+    void walkMmapped(const std::vector<Arena> &arenas, ArenaReport &report, SiteMap &sites);
+
+    void countChunk(Process::MemoryAddress tag, size_t size, bool inUse, ArenaReport &report, SiteMap &sites);
+
+    static size_t sizeClassIndex(size_t size);
+    static size_t sizeClassLimit(size_t index);
+
+    Process::ProcessID processID;
+    MemoryMap memoryMap;
+
+    const ArenaLayout *layout = nullptr;
+};
+
+#endif // HEAPWALKER_H
@@ -0,0 +1,352 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <list>
+#include <mutex>
+#include <sstream>
+
+/**
+ * @brief The ThreadCounters struct  The counters of one thread. Only the owner thread writes them
+ * (relaxed load and store, no read-modify-write), other threads only read them.
+ */
+struct Instrumentation::ThreadCounters
+{
+    typedef std::atomic<uint64_t> Counter;
+
+    Operation currentOperation = OperationOther;
+
+    Counter operations[OperationsCount];
+    Counter calls[OperationsCount][RequestsCount];
+
+    Counter latencyCounts[RequestsCount][Histogram::bucketsCount];
+    Counter latencyTotals[RequestsCount];
+    Counter latencyMaximums[RequestsCount];
+
+    ThreadCounters();
+    ~ThreadCounters();
+
+    static void increment(Counter &counter, uint64_t value = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void addTo(Snapshot &snapshot) const;
+    void clear();
+};
+
+namespace {
+
+std::mutex registryMutex;
+std::list<const Instrumentation::ThreadCounters *> registry;
+
+// The counters of the threads that already ended.
+Instrumentation::Snapshot retired;
+
+const char *const operationNames[] = {
+    "other", "attach", "detach", "read", "write", "call", "step", "continue", "wait", "registers", "lookup", "stop"
+};
+
+const char *const requestNames[] = {
+    "ptrace_peek", "ptrace_poke", "ptrace_registers", "ptrace_resume", "ptrace_attach", "ptrace_other",
+    "waitpid", "vm_read", "vm_write", "procfs"
+};
+
+}
+
+Instrumentation::ThreadCounters::ThreadCounters()
+{
+    clear();
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    registry.push_back(this);
+}
+
+Instrumentation::ThreadCounters::~ThreadCounters()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    addTo(retired);
+
+    registry.remove(this);
+}
+
+void Instrumentation::ThreadCounters::addTo(Snapshot &snapshot) const
+{
+    for(unsigned int operation = 0; operation < OperationsCount; ++operation) {
+        snapshot.operations[operation] += operations[operation].load(std::memory_order_relaxed);
+
+        for(unsigned int request = 0; request < RequestsCount; ++request)
+            snapshot.calls[operation][request] += calls[operation][request].load(std::memory_order_relaxed);
+    }
+
+    for(unsigned int request = 0; request < RequestsCount; ++request) {
+        Histogram &histogram = snapshot.latencies[request];
+
+        for(unsigned int bucket = 0; bucket < Histogram::bucketsCount; ++bucket) {
+            const uint64_t count = latencyCounts[request][bucket].load(std::memory_order_relaxed);
+
+            histogram.counts[bucket] += count;
+            histogram.count += count;
+        }
+
+        histogram.total += latencyTotals[request].load(std::memory_order_relaxed);
+        histogram.maximum = std::max(histogram.maximum, latencyMaximums[request].load(std::memory_order_relaxed));
+    }
+}
+
+void Instrumentation::ThreadCounters::clear()
+{
+    for(auto &counter : operations)
+        counter.store(0, std::memory_order_relaxed);
+
+    for(auto &row : calls)
+        for(auto &counter : row)
+            counter.store(0, std::memory_order_relaxed);
+
+    for(auto &row : latencyCounts)
+        for(auto &counter : row)
+            counter.store(0, std::memory_order_relaxed);
+
+    for(unsigned int request = 0; request < RequestsCount; ++request) {
+        latencyTotals[request].store(0, std::memory_order_relaxed);
+        latencyMaximums[request].store(0, std::memory_order_relaxed);
+    }
+}
+
+unsigned int Instrumentation::Histogram::bucketIndex(uint64_t value)
+{
+    if(value < subBucketsCount)
+        return value;
+
+    unsigned int bits = 64 - __builtin_clzll(value);
+
+    if(bits > maximumBits)
+        return bucketsCount-1;
+
+    const unsigned int shift = bits - subBucketBits - 1;
+
+    // The leading bit is implied, the next subBucketBits bits pick the sub-bucket.
+    return (shift + 1) * subBucketsCount + ((value >> shift) & (subBucketsCount-1));
+}
+
+uint64_t Instrumentation::Histogram::bucketValue(unsigned int index)
+{
+    if(index < subBucketsCount)
+        return index;
+
+    const unsigned int shift = index / subBucketsCount - 1;
+    const uint64_t subBucket = index % subBucketsCount;
+
+    return (((subBucketsCount + subBucket + 1) << shift) - 1);
+}
+
+uint64_t Instrumentation::Histogram::percentile(double percent) const
+{
+    if(count == 0)
+        return 0;
+
+    const uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(count * percent / 100 + 0.5));
+    uint64_t seen = 0;
+
+    for(unsigned int bucket = 0; bucket < bucketsCount; ++bucket) {
+        seen += counts[bucket];
+
+        if(seen >= target)
+            return std::min(bucketValue(bucket), maximum);
+    }
+
+    return maximum;
+}
+
+std::string Instrumentation::Snapshot::toText() const
+{
+    std::ostringstream stream;
+
+    stream << "operation           count";
+
+    for(unsigned int request = 0; request < RequestsCount; ++request)
+        stream << ' ' << requestNames[request];
+
+    stream << '\n';
+
+    for(unsigned int operation = 0; operation < OperationsCount; ++operation) {
+        stream << std::left << std::setw(12) << operationNames[operation] << std::right << std::setw(13) << operations[operation];
+
+        for(unsigned int request = 0; request < RequestsCount; ++request)
+            stream << ' ' << std::setw(std::strlen(requestNames[request])) << calls[operation][request];
+
+        stream << '\n';
+    }
+
+    stream << "\nrequest           count    mean_ns     p50_ns     p99_ns     max_ns\n";
+
+    for(unsigned int request = 0; request < RequestsCount; ++request) {
+        const Histogram &histogram = latencies[request];
+
+        if(histogram.count == 0)
+            continue;
+
+        char line[160];
+
+        std::snprintf(line, sizeof(line), "%-16s %6llu %10llu %10llu %10llu %10llu\n", requestNames[request],
+                      static_cast<unsigned long long>(histogram.count),
+                      static_cast<unsigned long long>(histogram.total / histogram.count),
+                      static_cast<unsigned long long>(histogram.percentile(50)),
+                      static_cast<unsigned long long>(histogram.percentile(99)),
+                      static_cast<unsigned long long>(histogram.maximum));
+
+        stream << line;
+    }
+
+    return stream.str();
+}
+
+std::string Instrumentation::Snapshot::toJson() const
+{
+    std::ostringstream stream;
+
+    stream << "{\"operations\":{";
+
+    for(unsigned int operation = 0; operation < OperationsCount; ++operation) {
+        if(operation != 0)
+            stream << ',';
+
+        stream << '"' << operationNames[operation] << "\":{\"count\":" << operations[operation] << ",\"calls\":{";
+
+        for(unsigned int request = 0; request < RequestsCount; ++request) {
+            if(request != 0)
+                stream << ',';
+
+            stream << '"' << requestNames[request] << "\":" << calls[operation][request];
+        }
+
+        stream << "}}";
+    }
+
+    stream << "},\"requests\":{";
+
+    for(unsigned int request = 0; request < RequestsCount; ++request) {
+        const Histogram &histogram = latencies[request];
+
+        if(request != 0)
+            stream << ',';
+
+        stream << '"' << requestNames[request] << "\":{\"count\":" << histogram.count
+               << ",\"total_ns\":" << histogram.total
+               << ",\"p50_ns\":" << histogram.percentile(50)
+               << ",\"p90_ns\":" << histogram.percentile(90)
+               << ",\"p99_ns\":" << histogram.percentile(99)
+               << ",\"max_ns\":" << histogram.maximum << '}';
+    }
+
+    stream << "}}";
+
+    return stream.str();
+}
+
+Instrumentation::OperationScope::OperationScope(Operation operation)
+{
+    ThreadCounters &counters = threadCounters();
+
+    outermost = counters.currentOperation == OperationOther;
+
+    if(outermost) {
+        counters.currentOperation = operation;
+
+        ThreadCounters::increment(counters.operations[operation]);
+    }
+}
+
+Instrumentation::OperationScope::~OperationScope()
+{
+    if(outermost)
+        threadCounters().currentOperation = OperationOther;
+}
+
+Instrumentation::RequestTimer::RequestTimer(Request request)
+    : request(request), startTime(std::chrono::steady_clock::now())
+{
+}
+
+Instrumentation::RequestTimer::~RequestTimer()
+{
+    const uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    ThreadCounters &counters = threadCounters();
+
+    ThreadCounters::increment(counters.calls[counters.currentOperation][request]);
+    ThreadCounters::increment(counters.latencyCounts[request][Histogram::bucketIndex(elapsed)]);
+    ThreadCounters::increment(counters.latencyTotals[request], elapsed);
+
+    if(elapsed > counters.latencyMaximums[request].load(std::memory_order_relaxed))
+        counters.latencyMaximums[request].store(elapsed, std::memory_order_relaxed);
+}
+
+Instrumentation::Snapshot Instrumentation::snapshot()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    Snapshot snapshot = retired;
+
+    for(const auto counters : registry)
+        counters->addTo(snapshot);
+
+    return snapshot;
+}
+
+void Instrumentation::reset()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    std::memset(&retired, 0, sizeof(retired));
+
+    // Not atomic with the owners' increments: a call in flight may be lost, which is fine for statistics.
+    for(const auto counters : registry)
+        const_cast<ThreadCounters *>(counters)->clear();
+}
+
+const char *Instrumentation::operationName(Operation operation)
+{
+    return operationNames[operation];
+}
+
+const char *Instrumentation::requestName(Request request)
+{
+    return requestNames[request];
+}
+
+Instrumentation::ThreadCounters &Instrumentation::threadCounters()
+{
+    static thread_local ThreadCounters counters;
+
+    return counters;
+}
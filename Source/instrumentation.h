@@ -0,0 +1,180 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The Instrumentation class  Count the system calls (ptrace, waitpid, /proc, process_vm_*) behind each Process operation,
+ * and keep a latency histogram per kind of call.
+ * Counters are per thread and written without locks; snapshot() sums them.
+ * Define PROCESS_NO_INSTRUMENTATION to compile the hooks out.
+ */
+class Instrumentation
+{
+public:
+    /**
+     * @brief The Operation enum  The high-level operation the calls are done for.
+     */
+    enum Operation {
+        OperationOther,
+        OperationAttach,
+        OperationDetach,
+        OperationRead,
+        OperationWrite,
+        OperationCall,
+        OperationStep,
+        OperationContinue,
+        OperationWait,
+        OperationRegisters,
+        OperationLookup,
+        OperationStop,
+        OperationsCount
+    };
+
+    /**
+     * @brief The Request enum  The kind of system call.
+     */
+    enum Request {
+        RequestPtracePeek,
+        RequestPtracePoke,
+        RequestPtraceRegisters,
+        RequestPtraceResume,
+        RequestPtraceAttach,
+        RequestPtraceOther,
+        RequestWaitpid,
+        RequestVmRead,
+        RequestVmWrite,
+        RequestProcfs,
+        RequestsCount
+    };
+
+    /**
+     * @brief The Histogram struct  Log-linear (HDR style) latency buckets: 16 linear sub-buckets per power of two,
+     * so every bucket is within ~6% of its values. Nanoseconds, up to 2^40 (~18 minutes).
+     */
+    struct Histogram
+    {
+        static const unsigned int subBucketBits = 4;
+        static const unsigned int subBucketsCount = 1 << subBucketBits;
+        static const unsigned int maximumBits = 40;
+        static const unsigned int bucketsCount = (maximumBits - subBucketBits + 1) * subBucketsCount;
+
+        static unsigned int bucketIndex(uint64_t value);
+
+        /**
+         * @brief bucketValue  The highest value of a bucket.
+         */
+        static uint64_t bucketValue(unsigned int index);
+
+        uint64_t counts[bucketsCount];
+        uint64_t count;
+        uint64_t total;
+        uint64_t maximum;
+
+        uint64_t percentile(double percent) const;
+    };
+
+    struct Snapshot
+    {
+        uint64_t operations[OperationsCount];
+
+        /**
+         * @brief calls  How many calls of each kind each operation made.
+         */
+        uint64_t calls[OperationsCount][RequestsCount];
+
+        Histogram latencies[RequestsCount];
+
+        std::string toText() const;
+        std::string toJson() const;
+    };
+
+    /**
+     * @brief The OperationScope class  Attribute the calls made during its lifetime to @arg operation.
+     * Nested scopes count toward the outermost one (e.g. the write() inside call()).
+     */
+    class OperationScope
+    {
+    public:
+        explicit OperationScope(Operation operation);
+        ~OperationScope();
+
+    private:
+        bool outermost;
+    };
+
+    /**
+     * @brief The RequestTimer class  Count one call of @arg request and time it until the timer's destruction.
+     */
+    class RequestTimer
+    {
+    public:
+        explicit RequestTimer(Request request);
+        ~RequestTimer();
+
+    private:
+        Request request;
+        std::chrono::steady_clock::time_point startTime;
+    };
+
+    /**
+     * @brief snapshot  Sum the counters of every thread (including the finished ones).
+     */
+    static Snapshot snapshot();
+
+    /**
+     * @brief reset  Zero the counters of every thread.
+     */
+    static void reset();
+
+    static const char *operationName(Operation operation);
+    static const char *requestName(Request request);
+
+    /**
+     * @brief The ThreadCounters struct  The counters of one thread (internal).
+     */
+    struct ThreadCounters;
+
+private:
+    static ThreadCounters &threadCounters();
+};
+
+#ifdef PROCESS_NO_INSTRUMENTATION
+# define PROCESS_INSTRUMENT_OPERATION(operation)
+# define PROCESS_INSTRUMENT_REQUEST(request)
+#else
+# define PROCESS_INSTRUMENT_OPERATION(operation) Instrumentation::OperationScope instrumentationOperationScope(Instrumentation::operation)
+# define PROCESS_INSTRUMENT_REQUEST(request) Instrumentation::RequestTimer instrumentationRequestTimer(request)
+#endif
+
+#endif // INSTRUMENTATION_H
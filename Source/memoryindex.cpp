@@ -0,0 +1,595 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+
+#include "memoryindex.h"
+#include "memorymap.h"
+#include "varint.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+typedef uintptr_t Word;
+
+/**
+ * @brief classify  Set a bit in @arg printable for every printable ASCII byte (or tab) of the 64 bytes at @arg bytes,
+ * and one in @arg zeros for every NUL byte.
+ */
+inline void classify(const uint8_t *bytes, uint64_t &printable, uint64_t &zeros)
+{
+    printable = 0;
+    zeros = 0;
+
+#if defined(__SSE2__)
+    // Signed comparisons: the bytes >= 0x80 are negative, hence not greater than 0x1f.
+    const __m128i space = _mm_set1_epi8(0x1f);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i nul = _mm_setzero_si128();
+
+    for(unsigned int i = 0; i < 4; ++i) {
+        const __m128i vector = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + 16 * i));
+        const __m128i isPrintable = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(vector, space), _mm_cmplt_epi8(vector, del)),
+                                                 _mm_cmpeq_epi8(vector, tab));
+
+        printable |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(isPrintable))) << (16 * i);
+        zeros |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(vector, nul)))) << (16 * i);
+    }
+#else
+    for(unsigned int i = 0; i < 64; ++i) {
+        const uint8_t byte = bytes[i];
+
+        printable |= static_cast<uint64_t>((byte >= 0x20 && byte < 0x7f) || byte == '\t') << i;
+        zeros |= static_cast<uint64_t>(byte == 0) << i;
+    }
+#endif
+}
+
+/**
+ * @brief evenBits  Gather the 32 even bits of @arg bits into the low half.
+ */
+inline uint64_t evenBits(uint64_t bits)
+{
+    bits &= 0x5555555555555555ull;
+    bits = (bits | (bits >> 1)) & 0x3333333333333333ull;
+    bits = (bits | (bits >> 2)) & 0x0f0f0f0f0f0f0f0full;
+    bits = (bits | (bits >> 4)) & 0x00ff00ff00ff00ffull;
+    bits = (bits | (bits >> 8)) & 0x0000ffff0000ffffull;
+    bits = (bits | (bits >> 16)) & 0x00000000ffffffffull;
+
+    return bits;
+}
+
+/**
+ * @brief findNext  The first bit of @arg bitmap from @arg position on that equals @arg set, or @arg count.
+ */
+inline size_t findNext(const uint64_t *bitmap, size_t position, size_t count, bool set)
+{
+    while(position < count) {
+        uint64_t word = set ? bitmap[position / 64] : ~bitmap[position / 64];
+
+        word &= ~0ull << (position % 64);
+
+        if(word != 0)
+            return std::min(count, (position & ~static_cast<size_t>(63)) + __builtin_ctzll(word));
+
+        position = (position & ~static_cast<size_t>(63)) + 64;
+    }
+
+    return count;
+}
+
+} // namespace
+
+/**
+ * @brief The Scan struct  The mapped intervals for the pointer lookups, the bitmaps of the current block and the results.
+ */
+struct MemoryIndex::Scan
+{
+    std::vector<uint64_t> intervalStarts;
+    std::vector<uint64_t> intervalEnds;
+    uint64_t lowest = 0;
+    uint64_t span = 0;
+
+    /**
+     * @brief lastInterval  Pointers cluster: most lookups hit the interval of the previous one.
+     */
+    size_t lastInterval = 0;
+
+    std::vector<uint64_t> printable;
+    std::vector<uint64_t> zeros;
+    std::vector<uint64_t> wideUnits;
+
+    std::vector<StringEntry> strings;
+    std::string texts;
+    std::vector<Reference> references;
+
+    bool isMapped(uint64_t value) {
+        if(value - lowest >= span)
+            return false;
+
+        if(value >= intervalStarts[lastInterval] && value < intervalEnds[lastInterval])
+            return true;
+
+        const size_t interval = std::upper_bound(intervalStarts.begin(), intervalStarts.end(), value) - intervalStarts.begin() - 1;
+
+        if(value >= intervalEnds[interval])
+            return false;
+
+        lastInterval = interval;
+
+        return true;
+    }
+};
+
+const size_t MemoryIndex::blockSize;
+const size_t MemoryIndex::entriesPerBlock;
+
+MemoryIndex::MemoryIndex(Process::ProcessID processID)
+    : MemoryIndex(processID, Options())
+{
+}
+
+MemoryIndex::MemoryIndex(Process::ProcessID processID, const Options &options)
+    : processID(processID), options(options), statistics()
+{
+    if(options.minimumStringLength < 2)
+        throw std::invalid_argument("MemoryIndex: the minimum string length must be at least 2");
+}
+
+void MemoryIndex::build()
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    statistics = Statistics();
+
+    MemoryMap memoryMap(processID);
+    Scan scan;
+
+    // The mapped intervals, with the adjacent regions merged.
+    for(const auto &region : memoryMap.getRegions()) {
+        const uint64_t start = region.start;
+        const uint64_t end = region.end;
+
+        if(!scan.intervalEnds.empty() && scan.intervalEnds.back() == start)
+            scan.intervalEnds.back() = end;
+        else {
+            scan.intervalStarts.push_back(start);
+            scan.intervalEnds.push_back(end);
+        }
+    }
+
+    if(!scan.intervalStarts.empty()) {
+        scan.lowest = scan.intervalStarts.front();
+        scan.span = scan.intervalEnds.back() - scan.lowest;
+    }
+
+    std::vector<uint8_t> block(blockSize + 128);
+
+    scan.printable.resize(blockSize / 64 + 2);
+    scan.zeros.resize(scan.printable.size());
+    scan.wideUnits.resize(scan.printable.size() / 2 + 1);
+
+    for(const auto &region : memoryMap.getRegions()) {
+        // Reading the device mappings may have side effects; [vvar] and [vsyscall] can't be read anyway.
+        if(!region.readable || region.path == "[vvar]" || region.path == "[vsyscall]" || region.path.compare(0, 5, "/dev/") == 0)
+            continue;
+
+        if(!options.fileMappings && !region.writable && !region.path.empty() && region.path[0] == '/')
+            continue;
+
+        ++statistics.regions;
+
+        RunState asciiRun;
+        RunState wideRun;
+
+        for(uint64_t address = region.start; address < static_cast<uint64_t>(region.end); address += blockSize) {
+            const size_t bytesCount = std::min<uint64_t>(blockSize, region.end - address);
+            const ssize_t readCount = Process::readMemory(processID, address, block.data(), bytesCount);
+            const size_t scannedCount = readCount > 0 ? static_cast<size_t>(readCount) & ~static_cast<size_t>(1) : 0;
+
+            if(scannedCount > 0) {
+                scanBlock(scan, address, block.data(), scannedCount);
+
+                scanRuns(scan, asciiRun, scan.printable.data(), scannedCount, address, block.data(), false);
+
+                if(options.wideStrings)
+                    scanRuns(scan, wideRun, scan.wideUnits.data(), scannedCount / 2, address, block.data(), true);
+
+                statistics.scannedBytes += scannedCount;
+            }
+
+            // A hole ends the runs.
+            if(scannedCount < bytesCount) {
+                statistics.unreadableBytes += bytesCount - scannedCount;
+
+                closeRun(scan, asciiRun, false);
+                closeRun(scan, wideRun, true);
+            }
+        }
+
+        closeRun(scan, asciiRun, false);
+        closeRun(scan, wideRun, true);
+    }
+
+    statistics.strings = scan.strings.size();
+    statistics.pointers = scan.references.size();
+
+    encodeStrings(scan.strings, scan.texts);
+    encodePointers(scan.references);
+
+    statistics.indexBytes = stringBlocks.size() * sizeof(StringBlock) + stringData.size() + texts.size() +
+            pointerBlocks.size() * sizeof(PointerBlock) + pointerData.size();
+    statistics.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void MemoryIndex::scanBlock(Scan &scan, uint64_t address, uint8_t *bytes, size_t bytesCount)
+{
+    // The block has room for the padding; NUL bytes are neither printable nor part of a wide character.
+    std::memset(bytes + bytesCount, 0, 128);
+
+    const size_t wordsCount = (bytesCount + 63) / 64;
+
+    for(size_t i = 0; i < wordsCount; ++i)
+        classify(bytes + 64 * i, scan.printable[i], scan.zeros[i]);
+
+    scan.printable[wordsCount] = 0;
+    scan.zeros[wordsCount] = 0;
+
+    // A wide character: a printable byte at an even offset, followed by a NUL.
+    if(options.wideStrings) {
+        for(size_t i = 0; i < (wordsCount + 1) / 2; ++i) {
+            scan.wideUnits[i] = evenBits(scan.printable[2 * i] & (scan.zeros[2 * i] >> 1)) |
+                    (evenBits(scan.printable[2 * i + 1] & (scan.zeros[2 * i + 1] >> 1)) << 32);
+        }
+    }
+
+    if(!options.pointers)
+        return;
+
+    const size_t wordSize = sizeof(Word);
+
+    for(size_t offset = 0; offset + wordSize <= bytesCount; offset += wordSize) {
+        Word value;
+
+        std::memcpy(&value, bytes + offset, wordSize);
+
+        if(scan.isMapped(value))
+            scan.references.push_back(Reference{ static_cast<Process::MemoryAddress>(value),
+                                                 static_cast<Process::MemoryAddress>(address + offset) });
+    }
+}
+
+void MemoryIndex::scanRuns(Scan &scan, RunState &run, const uint64_t *bitmap, size_t unitsCount, uint64_t address,
+                           const uint8_t *bytes, bool wide)
+{
+    const size_t unitSize = wide ? 2 : 1;
+    size_t position = 0;
+
+    while(position < unitsCount) {
+        if(!run.open) {
+            position = findNext(bitmap, position, unitsCount, true);
+
+            if(position == unitsCount)
+                break;
+
+            run.open = true;
+            run.address = address + position * unitSize;
+            run.length = 0;
+            run.text.clear();
+        }
+
+        const size_t end = findNext(bitmap, position, unitsCount, false);
+        const size_t storedCount = std::min<size_t>(end - position, storedLength(run.length + end - position) - run.text.size());
+
+        if(wide) {
+            for(size_t unit = position; unit < position + storedCount; ++unit)
+                run.text.push_back(static_cast<char>(bytes[2 * unit]));
+        } else
+            run.text.append(reinterpret_cast<const char *>(bytes + position), storedCount);
+
+        run.length += end - position;
+
+        // A run reaching the end of the block may go on in the next one.
+        if(end < unitsCount)
+            closeRun(scan, run, wide);
+
+        position = end;
+    }
+}
+
+void MemoryIndex::closeRun(Scan &scan, RunState &run, bool wide)
+{
+    if(!run.open)
+        return;
+
+    run.open = false;
+
+    if(run.length < options.minimumStringLength)
+        return;
+
+    scan.strings.push_back(StringEntry{ run.address, run.length, wide, scan.texts.size() });
+    scan.texts += run.text;
+
+    if(wide)
+        ++statistics.wideStrings;
+}
+
+size_t MemoryIndex::storedLength(uint64_t length) const
+{
+    return static_cast<size_t>(std::min<uint64_t>(length, options.maximumStoredLength));
+}
+
+void MemoryIndex::encodeStrings(std::vector<StringEntry> &entries, const std::string &scannedTexts)
+{
+    stringBlocks.clear();
+    stringData.clear();
+    texts.clear();
+
+    // The ASCII and the wide runs of a block were found apart.
+    std::sort(entries.begin(), entries.end(), [](const StringEntry &first, const StringEntry &second) {
+        return first.address < second.address;
+    });
+
+    texts.reserve(scannedTexts.size());
+
+    StringEntry previous{};
+
+    for(size_t i = 0; i < entries.size(); ++i) {
+        const StringEntry &entry = entries[i];
+
+        if(i % entriesPerBlock == 0) {
+            stringBlocks.push_back(StringBlock{ entry.address, stringData.size(), texts.size() });
+            previous = StringEntry{ entry.address, 0, false, texts.size() };
+        }
+
+        Varint::encode(entry.address - previous.address, stringData);
+        Varint::encode(entry.length << 1 | entry.wide, stringData);
+
+        texts.append(scannedTexts, entry.textOffset, storedLength(entry.length));
+
+        previous = entry;
+    }
+
+    stringData.shrink_to_fit();
+    texts.shrink_to_fit();
+}
+
+void MemoryIndex::encodePointers(std::vector<Reference> &references)
+{
+    pointerBlocks.clear();
+    pointerData.clear();
+
+    std::sort(references.begin(), references.end(), [](const Reference &first, const Reference &second) {
+        return static_cast<uint64_t>(first.value) < static_cast<uint64_t>(second.value) ||
+                (first.value == second.value && static_cast<uint64_t>(first.referrer) < static_cast<uint64_t>(second.referrer));
+    });
+
+    Reference previous{};
+
+    for(size_t i = 0; i < references.size(); ++i) {
+        const Reference &reference = references[i];
+
+        if(i % entriesPerBlock == 0) {
+            pointerBlocks.push_back(PointerBlock{ static_cast<uint64_t>(reference.value), static_cast<uint64_t>(reference.referrer),
+                                                  pointerData.size() });
+            previous = reference;
+        }
+
+        // The values only grow; the referrers of different values are unordered.
+        Varint::encode(static_cast<uint64_t>(reference.value) - static_cast<uint64_t>(previous.value), pointerData);
+        Varint::encodeSigned(static_cast<int64_t>(static_cast<uint64_t>(reference.referrer) - static_cast<uint64_t>(previous.referrer)),
+                             pointerData);
+
+        previous = reference;
+    }
+
+    pointerData.shrink_to_fit();
+}
+
+bool MemoryIndex::decodeString(const uint8_t *&position, const uint8_t *end, const StringEntry &previous, StringEntry &entry) const
+{
+    uint64_t delta, lengthAndWide;
+
+    if(!Varint::decode(position, end, delta) || !Varint::decode(position, end, lengthAndWide))
+        return false;
+
+    entry.address = previous.address + delta;
+    entry.length = lengthAndWide >> 1;
+    entry.wide = lengthAndWide & 1;
+    entry.textOffset = previous.textOffset + storedLength(previous.length);
+
+    return true;
+}
+
+bool MemoryIndex::decodeReference(const uint8_t *&position, const uint8_t *end, const Reference &previous, Reference &reference) const
+{
+    uint64_t delta;
+    int64_t referrerDelta;
+
+    if(!Varint::decode(position, end, delta) || !Varint::decodeSigned(position, end, referrerDelta))
+        return false;
+
+    reference.value = static_cast<Process::MemoryAddress>(static_cast<uint64_t>(previous.value) + delta);
+    reference.referrer = static_cast<Process::MemoryAddress>(static_cast<uint64_t>(previous.referrer) + static_cast<uint64_t>(referrerDelta));
+
+    return true;
+}
+
+template<typename Visitor>
+void MemoryIndex::visitStrings(size_t firstBlock, Visitor visitor) const
+{
+    for(size_t block = firstBlock; block < stringBlocks.size(); ++block) {
+        const uint8_t *position = stringData.data() + stringBlocks[block].dataOffset;
+        const uint8_t *end = block + 1 < stringBlocks.size() ? stringData.data() + stringBlocks[block + 1].dataOffset
+                                                             : stringData.data() + stringData.size();
+
+        StringEntry entry{ stringBlocks[block].address, 0, false, stringBlocks[block].textOffset };
+
+        while(position < end) {
+            const StringEntry previous = entry;
+
+            if(!decodeString(position, end, previous, entry))
+                throw std::runtime_error("MemoryIndex: corrupt string index");
+
+            if(!visitor(entry))
+                return;
+        }
+    }
+}
+
+MemoryIndex::String MemoryIndex::makeString(const StringEntry &entry) const
+{
+    return String{ static_cast<Process::MemoryAddress>(entry.address), entry.length, entry.wide,
+                texts.substr(entry.textOffset, storedLength(entry.length)) };
+}
+
+bool MemoryIndex::stringAt(Process::MemoryAddress address, String &string) const
+{
+    const uint64_t target = address;
+
+    // The last block starting at or before the address.
+    auto block = std::upper_bound(stringBlocks.begin(), stringBlocks.end(), target, [](uint64_t target, const StringBlock &block) {
+        return target < block.address;
+    });
+
+    if(block == stringBlocks.begin())
+        return false;
+
+    bool found = false;
+
+    visitStrings(block - stringBlocks.begin() - 1, [&](const StringEntry &entry) {
+        if(entry.address > target)
+            return false;
+
+        if(target < entry.address + (entry.wide ? entry.length * 2 : entry.length)) {
+            string = makeString(entry);
+            found = true;
+        }
+
+        return true;
+    });
+
+    return found;
+}
+
+std::vector<MemoryIndex::String> MemoryIndex::findStrings(const std::string &text, size_t maximumCount) const
+{
+    std::vector<String> strings;
+
+    if(text.empty())
+        return strings;
+
+    // Search the texts at once, then find the string of every match.
+    for(size_t match = texts.find(text); match != std::string::npos && strings.size() < maximumCount; ) {
+        auto block = std::upper_bound(stringBlocks.begin(), stringBlocks.end(), match, [](size_t match, const StringBlock &block) {
+            return match < block.textOffset;
+        }) - 1;
+
+        size_t next = match + 1;
+
+        visitStrings(block - stringBlocks.begin(), [&](const StringEntry &entry) {
+            const size_t textEnd = entry.textOffset + storedLength(entry.length);
+
+            if(textEnd <= match)
+                return true;
+
+            // A match across two texts doesn't count.
+            if(match + text.size() <= textEnd)
+                strings.push_back(makeString(entry));
+
+            next = std::max(next, textEnd);
+
+            return false;
+        });
+
+        match = texts.find(text, next);
+    }
+
+    return strings;
+}
+
+std::vector<Process::MemoryAddress> MemoryIndex::referrersOf(Process::MemoryAddress value) const
+{
+    std::vector<Process::MemoryAddress> referrers;
+
+    for(const auto &reference : referencesTo(value, static_cast<Process::MemoryAddress>(static_cast<uint64_t>(value) + 1)))
+        referrers.push_back(reference.referrer);
+
+    return referrers;
+}
+
+std::vector<MemoryIndex::Reference> MemoryIndex::referencesTo(Process::MemoryAddress first, Process::MemoryAddress last) const
+{
+    std::vector<Reference> references;
+
+    const uint64_t lowest = first;
+    const uint64_t highest = last;
+
+    if(lowest >= highest)
+        return references;
+
+    // The references to the first value may start in the block before the first one starting at it.
+    auto block = std::lower_bound(pointerBlocks.begin(), pointerBlocks.end(), lowest, [](const PointerBlock &block, uint64_t lowest) {
+        return block.value < lowest;
+    });
+
+    if(block != pointerBlocks.begin())
+        --block;
+
+    for(; block != pointerBlocks.end() && block->value < highest; ++block) {
+        const uint8_t *position = pointerData.data() + block->dataOffset;
+        const uint8_t *end = block + 1 != pointerBlocks.end() ? pointerData.data() + (block + 1)->dataOffset
+                                                                : pointerData.data() + pointerData.size();
+
+        Reference reference{ static_cast<Process::MemoryAddress>(block->value), static_cast<Process::MemoryAddress>(block->referrer) };
+
+        while(position < end) {
+            const Reference previous = reference;
+
+            if(!decodeReference(position, end, previous, reference))
+                throw std::runtime_error("MemoryIndex: corrupt pointer index");
+
+            const uint64_t value = reference.value;
+
+            if(value >= highest)
+                return references;
+
+            if(value >= lowest)
+                references.push_back(reference);
+        }
+    }
+
+    return references;
+}
@@ -0,0 +1,240 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+
+#ifndef MEMORYINDEX_H
+#define MEMORYINDEX_H
+
+#include "process.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief The MemoryIndex class  Strings and pointer candidates of a whole address space, extracted in one pass.
+ * Every readable region is streamed in blocks with process_vm_readv(). The bytes of a block are classified
+ * 64 at a time (SSE2 when available) into printable/NUL bitmaps, from which the ASCII runs and the UTF-16LE
+ * runs (printable ASCII characters, 2 bytes aligned) are taken. Every aligned word that lands in a mapped
+ * region is kept as a pointer candidate.
+ * The results are kept sorted and delta-varint compressed in blocks, with a skip list of the block heads,
+ * so that the queries decode only a block or two.
+ * @note Stop the process first (e.g. with a ThreadGroup) to index a consistent picture.
+ */
+class MemoryIndex
+{
+public:
+    struct Options
+    {
+        /**
+         * @brief minimumStringLength  The shortest run kept, in characters (at least 2).
+         */
+        size_t minimumStringLength = 4;
+
+        /**
+         * @brief maximumStoredLength  Longer strings are indexed with their full length but only their beginning is kept.
+         */
+        size_t maximumStoredLength = 1024;
+
+        bool wideStrings = true;
+        bool pointers = true;
+
+        /**
+         * @brief fileMappings  Also scan the read-only mappings of files (the images of the executable and the libraries).
+         */
+        bool fileMappings = true;
+    };
+
+    struct String
+    {
+        Process::MemoryAddress address;
+
+        /**
+         * @brief length  In characters; a wide string takes twice as many bytes.
+         */
+        uint64_t length;
+        bool wide;
+
+        /**
+         * @brief text  The characters (narrowed, for a wide string), up to Options::maximumStoredLength.
+         */
+        std::string text;
+
+        uint64_t bytesCount() const { return wide ? length * 2 : length; }
+    };
+
+    struct Reference
+    {
+        /**
+         * @brief value  The address pointed to.
+         */
+        Process::MemoryAddress value;
+
+        /**
+         * @brief referrer  Where the pointer is stored.
+         */
+        Process::MemoryAddress referrer;
+    };
+
+    struct Statistics
+    {
+        uint64_t regions;
+        uint64_t scannedBytes;
+        uint64_t unreadableBytes;
+
+        uint64_t strings;
+        uint64_t wideStrings;
+        uint64_t pointers;
+
+        /**
+         * @brief indexBytes  The size of the compressed index, texts included.
+         */
+        uint64_t indexBytes;
+
+        double buildMilliseconds;
+    };
+
+    explicit MemoryIndex(Process::ProcessID processID);
+    MemoryIndex(Process::ProcessID processID, const Options &options);
+
+    /**
+     * @brief build  (Re)index the whole address space.
+     */
+    void build();
+
+    /**
+     * @brief stringAt  Find the string containing @arg address.
+     * @return false if there's none.
+     */
+    bool stringAt(Process::MemoryAddress address, String &string) const;
+
+    /**
+     * @brief findStrings  Find the strings containing @arg text (in their stored part), by address.
+     */
+    std::vector<String> findStrings(const std::string &text, size_t maximumCount = 100) const;
+
+    /**
+     * @brief referrersOf  Where pointers to @arg value are stored, sorted.
+     */
+    std::vector<Process::MemoryAddress> referrersOf(Process::MemoryAddress value) const;
+
+    /**
+     * @brief referencesTo  The pointers to [@arg first, @arg last), e.g. into an object; sorted by value then referrer.
+     */
+    std::vector<Reference> referencesTo(Process::MemoryAddress first, Process::MemoryAddress last) const;
+
+    const Statistics &getStatistics() const { return statistics; }
+
+    /**
+     * @brief blockSize  The size regions are read in.
+     */
+    static const size_t blockSize = 1024*1024;
+
+    /**
+     * @brief entriesPerBlock  The entries of a compressed block; a query decodes at most this many before finding its first entry.
+     */
+    static const size_t entriesPerBlock = 64;
+
+private:
+    struct StringBlock
+    {
+        uint64_t address;
+        size_t dataOffset;
+        size_t textOffset;
+    };
+
+    struct PointerBlock
+    {
+        uint64_t value;
+        uint64_t referrer;
+        size_t dataOffset;
+    };
+
+    struct StringEntry
+    {
+        uint64_t address;
+        uint64_t length;
+        bool wide;
+
+        /**
+         * @brief textOffset  In the texts; the stored length is min(length, Options::maximumStoredLength).
+         */
+        size_t textOffset;
+    };
+
+    /**
+     * @brief The RunState struct  A run of characters, which may continue into the next block.
+     */
+    struct RunState
+    {
+        bool open = false;
+        uint64_t address = 0;
+        uint64_t length = 0;
+        std::string text;
+    };
+
+    /**
+     * @brief The Scan struct  The state of build().
+     */
+    struct Scan;
+
+    void scanBlock(Scan &scan, uint64_t address, uint8_t *bytes, size_t bytesCount);
+    void scanRuns(Scan &scan, RunState &run, const uint64_t *bitmap, size_t unitsCount, uint64_t address,
+                  const uint8_t *bytes, bool wide);
+    void closeRun(Scan &scan, RunState &run, bool wide);
+
+    void encodeStrings(std::vector<StringEntry> &entries, const std::string &texts);
+    void encodePointers(std::vector<Reference> &references);
+
+    size_t storedLength(uint64_t length) const;
+
+    /**
+     * @brief decodeString  Decode the entry at @arg position, which follows @arg previous (the block head for the first).
+     */
+    bool decodeString(const uint8_t *&position, const uint8_t *end, const StringEntry &previous, StringEntry &entry) const;
+    bool decodeReference(const uint8_t *&position, const uint8_t *end, const Reference &previous, Reference &reference) const;
+
+    /**
+     * @brief visitStrings  Visit the entries from @arg firstBlock on, until @arg visitor returns false.
+     */
+    template<typename Visitor>
+    void visitStrings(size_t firstBlock, Visitor visitor) const;
+
+    String makeString(const StringEntry &entry) const;
+
+    Process::ProcessID processID;
+    Options options;
+
+    std::vector<StringBlock> stringBlocks;
+    std::vector<uint8_t> stringData;
+    std::string texts;
+
+    std::vector<PointerBlock> pointerBlocks;
+    std::vector<uint8_t> pointerData;
+
+    Statistics statistics;
+};
+
+#endif // MEMORYINDEX_H
@@ -0,0 +1,96 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#include "memorymap.h"
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+MemoryMap::MemoryMap(Process::ProcessID processID)
+{
+    PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestProcfs);
+
+    const std::string mapsPath = "/proc/" + std::to_string(processID) + "/maps";
+
+    std::ifstream file(mapsPath.c_str());
+
+    if(!file)
+        throw std::invalid_argument("MemoryMap: can't open " + mapsPath);
+
+    std::string line;
+
+    while(std::getline(file, line)) {
+        // start-end perms offset device inode [path]
+        uintmax_t start, end, offset;
+        char permissions[5];
+        int pathPosition = 0;
+
+        if(std::sscanf(line.c_str(), "%jx-%jx %4s %jx %*s %*s %n", &start, &end, permissions, &offset, &pathPosition) < 4)
+            continue;
+
+        Region region;
+
+        region.start = start;
+        region.end = end;
+        region.readable = permissions[0] == 'r';
+        region.writable = permissions[1] == 'w';
+        region.executable = permissions[2] == 'x';
+        region.shared = permissions[3] == 's';
+        region.offset = offset;
+
+        if(pathPosition > 0)
+            region.path = line.substr(pathPosition);
+
+        mRegions.push_back(std::move(region));
+    }
+}
+
+const MemoryMap::Region *MemoryMap::find(Process::MemoryAddress address) const
+{
+    // Addresses are signed words, but /proc lists the regions in unsigned order: [vsyscall] would compare negative.
+    auto region = std::upper_bound(mRegions.begin(), mRegions.end(), address, [](Process::MemoryAddress address, const Region &region) {
+        return static_cast<uint64_t>(address) < static_cast<uint64_t>(region.end);
+    });
+
+    if(region == mRegions.end() || !region->contains(address))
+        return nullptr;
+
+    return &*region;
+}
+
+const MemoryMap::Region *MemoryMap::findByPath(const std::string &path) const
+{
+    for(const auto &region : mRegions) {
+        if(region.path == path)
+            return &region;
+    }
+
+    return nullptr;
+}
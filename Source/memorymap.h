@@ -0,0 +1,87 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#ifndef MEMORYMAP_H
+#define MEMORYMAP_H
+
+#include "process.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief The MemoryMap class  The mapped regions of a process, from /proc/processID/maps.
+ */
+class MemoryMap
+{
+public:
+    struct Region
+    {
+        Process::MemoryAddress start;
+        Process::MemoryAddress end;
+
+        bool readable;
+        bool writable;
+        bool executable;
+        bool shared;
+
+        uint64_t offset;
+
+        /**
+         * @brief path  The mapped file, a pseudo name ("[heap]", "[stack]"...) or empty for anonymous memory.
+         */
+        std::string path;
+
+        size_t size() const { return end - start; }
+        bool contains(Process::MemoryAddress address) const {
+            return static_cast<uint64_t>(address) >= static_cast<uint64_t>(start) && static_cast<uint64_t>(address) < static_cast<uint64_t>(end);
+        }
+    };
+
+    explicit MemoryMap(Process::ProcessID processID);
+
+    /**
+     * @brief getRegions  The regions, sorted by address.
+     */
+    const std::vector<Region> &getRegions() const { return mRegions; }
+
+    /**
+     * @brief find  Find the region containing @arg address (binary search).
+     * @return nullptr if the address isn't mapped.
+     */
+    const Region *find(Process::MemoryAddress address) const;
+
+    /**
+     * @brief findByPath  Find the first region mapping @arg path.
+     * @return nullptr if there's no such region.
+     */
+    const Region *findByPath(const std::string &path) const;
+
+private:
+    std::vector<Region> mRegions;
+};
+
+#endif // MEMORYMAP_H
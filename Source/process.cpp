@@ -26,16 +26,56 @@
  */
 
 #include "process.h"
+#include "instrumentation.h"
 
 #include <fstream>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <stdexcept>
 #include <vector>
 
 const char Process::procPath[] = "/proc/";
 
+#ifndef PROCESS_NO_INSTRUMENTATION
+namespace {
+
+Instrumentation::Request requestType(__ptrace_request request)
+{
+    switch(request) {
+    case PTRACE_PEEKTEXT:
+    case PTRACE_PEEKDATA:
+    case PTRACE_PEEKUSER:
+        return Instrumentation::RequestPtracePeek;
+    case PTRACE_POKETEXT:
+    case PTRACE_POKEDATA:
+    case PTRACE_POKEUSER:
+        return Instrumentation::RequestPtracePoke;
+    case PTRACE_GETREGS:
+    case PTRACE_SETREGS:
+    case PTRACE_GETFPREGS:
+    case PTRACE_SETFPREGS:
+        return Instrumentation::RequestPtraceRegisters;
+    case PTRACE_CONT:
+    case PTRACE_SYSCALL:
+    case PTRACE_SINGLESTEP:
+        return Instrumentation::RequestPtraceResume;
+    case PTRACE_ATTACH:
+    case PTRACE_SEIZE:
+    case PTRACE_DETACH:
+        return Instrumentation::RequestPtraceAttach;
+    default:
+        return Instrumentation::RequestPtraceOther;
+    }
+}
+
+}
+#endif
+
 Process::Process(const std::string &programName)
     : Process(programNameToProcessID(programName))
 {
@@ -44,6 +84,8 @@ Process::Process(const std::string &programName)
 Process::Process(Process::ProcessID processID)
     : processID(processID)
 {
+    PROCESS_INSTRUMENT_OPERATION(OperationAttach);
+
     ptrace(PTRACE_ATTACH, nullptr, nullptr);
 
     wait(WUNTRACED);
@@ -51,11 +93,17 @@ Process::Process(Process::ProcessID processID)
 
 Process::~Process()
 {
-    ptrace(PTRACE_DETACH, nullptr, nullptr);
+    PROCESS_INSTRUMENT_OPERATION(OperationDetach);
+    PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestPtraceAttach);
+
+    // The process may be gone already (e.g. it exited while traced); a destructor mustn't throw.
+    ::ptrace(PTRACE_DETACH, processID, nullptr, nullptr);
 }
 
 void Process::step()
 {
+    PROCESS_INSTRUMENT_OPERATION(OperationStep);
+
     ptrace(PTRACE_SINGLESTEP, nullptr, nullptr);
 }
 
@@ -66,15 +114,27 @@ void Process::stop()
 
 void Process::cont(int signal)
 {
+    PROCESS_INSTRUMENT_OPERATION(OperationContinue);
+
     ptrace(PTRACE_CONT, nullptr, signal);
 }
 
-void Process::continueAndStopOnSystemCall()
+void Process::continueAndStopOnSystemCall(int signal)
 {
-    ptrace(PTRACE_SYSCALL, nullptr, 0);
+    PROCESS_INSTRUMENT_OPERATION(OperationContinue);
+
+    ptrace(PTRACE_SYSCALL, nullptr, signal);
+}
+
+void Process::setOptions(int options)
+{
+    ptrace(PTRACE_SETOPTIONS, nullptr, options);
 }
 
 int Process::wait(int options) {
+    PROCESS_INSTRUMENT_OPERATION(OperationWait);
+    PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestWaitpid);
+
     int ret = 0;
 
     ::waitpid(processID, &ret, options);
@@ -88,6 +148,8 @@ void Process::kill(int signal)
 }
 
 Process::ProcessRegisters Process::getProcessRegisters() {
+    PROCESS_INSTRUMENT_OPERATION(OperationRegisters);
+
     ProcessRegisters processRegisters;
 
     ptrace(PTRACE_GETREGS, nullptr, &processRegisters);
@@ -97,6 +159,8 @@ Process::ProcessRegisters Process::getProcessRegisters() {
 
 void Process::setProcesssRegisters(const Process::ProcessRegisters &processRegisters)
 {
+    PROCESS_INSTRUMENT_OPERATION(OperationRegisters);
+
     ptrace(PTRACE_SETREGS, nullptr, const_cast<Process::ProcessRegisters *>(&processRegisters));
 }
 
@@ -113,80 +177,202 @@ void Process::jump(MemoryAddress ip) {
 }
 
 void Process::call(MemoryAddress address) {
+    PROCESS_INSTRUMENT_OPERATION(OperationCall);
+
     auto registers = getProcessRegisters();
 
     // Push the current ip register into the stack (the return address).
     // Jump to the address (by changing ip register).
 #ifdef __x86_64__
-//    registers.rsp -= sizeof(register_t);
-
-    push(registers.rip);
+    Register returnAddress = registers.rip;
 
     registers.rip = address;
 #elif defined __i386__
-//    registers.esp -= sizeof(register_t);
-
-    push(registers.eip);
+    Register returnAddress = registers.eip;
 
     registers.eip = address;
 #else
 # error "Your arch is not supported by Process"
 #endif
 
+    MemoryAddress stackPointer = getStackPointer(registers) - sizeof(returnAddress);
+
+    write(&returnAddress, sizeof(returnAddress), stackPointer);
+
+    setStackPointer(registers, stackPointer);
     setProcesssRegisters(registers);
 }
 
 void Process::movePointer(MemoryAddress sourceAddress, MemoryAddress destinationAddress)
 {
+    PROCESS_INSTRUMENT_OPERATION(OperationWrite);
+
     move(copyFrom(sourceAddress), destinationAddress);
 }
 
 void Process::move(Register source, MemoryAddress destinationAddress)
 {
+    PROCESS_INSTRUMENT_OPERATION(OperationWrite);
+
     ptrace(PTRACE_POKEDATA, destinationAddress, source);
 }
 
 void Process::write(const std::vector<Process::Byte> &bytesToWrite, Process::MemoryAddress destinationAddresss) {
-    const auto &bytesToWriteLength = bytesToWrite.size();
+    write(bytesToWrite.data(), bytesToWrite.size(), destinationAddresss);
+}
+
+void Process::write(const void *buffer, size_t bytesCount, MemoryAddress destinationAddress)
+{
+    PROCESS_INSTRUMENT_OPERATION(OperationWrite);
+
+    const Byte *source = static_cast<const Byte *>(buffer);
+
+    ssize_t bytesWritten = writeMemory(processID, destinationAddress, source, bytesCount);
+
+    // process_vm_writev() may be unavailable, forbidden or stop at a read-only page; poke the rest.
+    if(bytesWritten < 0)
+        bytesWritten = 0;
+
+    writeWords(source + bytesWritten, bytesCount - bytesWritten, destinationAddress + bytesWritten);
+}
+
+void Process::writeWords(const Byte *source, size_t bytesCount, MemoryAddress destinationAddress)
+{
+    const MemoryAddress wordMask = sizeof(Register)-1;
 
-    if(bytesToWriteLength % sizeof(Register) != 0) {
-        Register word = bytesToWrite[0];
+    // The partial head word: keep the bytes before the destination.
+    if(bytesCount > 0 && (destinationAddress & wordMask) != 0) {
+        const MemoryAddress alignedAddress = destinationAddress & ~wordMask;
+        const size_t offset = destinationAddress - alignedAddress;
+        const size_t bytesToCopy = std::min(sizeof(Register) - offset, bytesCount);
 
-        move(word, destinationAddresss++);
+        Register word = copyFrom(alignedAddress);
+
+        std::memcpy(reinterpret_cast<Byte *>(&word) + offset, source, bytesToCopy);
+
+        move(word, alignedAddress);
+
+        source += bytesToCopy;
+        destinationAddress += bytesToCopy;
+        bytesCount -= bytesToCopy;
     }
 
-    for(const Byte *pBytesToWrite = bytesToWrite.data(); pBytesToWrite < bytesToWrite.data()+bytesToWriteLength-1; pBytesToWrite+=2) {
-        Register word = *reinterpret_cast<const Register *>(pBytesToWrite);
+    // The aligned middle.
+    for(; bytesCount >= sizeof(Register); bytesCount -= sizeof(Register)) {
+        Register word;
 
-        move(word, destinationAddresss);
+        std::memcpy(&word, source, sizeof(Register));
 
-        destinationAddresss+=sizeof(Register);
+        move(word, destinationAddress);
+
+        source += sizeof(Register);
+        destinationAddress += sizeof(Register);
+    }
+
+    // The partial tail word: keep the bytes after the end.
+    if(bytesCount > 0) {
+        Register word = copyFrom(destinationAddress);
+
+        std::memcpy(&word, source, bytesCount);
+
+        move(word, destinationAddress);
     }
 }
 
 std::vector<Process::Byte> Process::read(Process::MemoryAddress sourceAddress, const std::vector<Byte>::size_type &bytesCount) {
-    std::vector<Byte> vector;
-    auto bytesToRead = bytesCount;
-    vector.resize(bytesToRead);
+    std::vector<Byte> vector(bytesCount);
+
+    read(sourceAddress, vector.data(), bytesCount);
+
+    return vector;
+}
+
+void Process::read(MemoryAddress sourceAddress, void *buffer, size_t bytesCount)
+{
+    PROCESS_INSTRUMENT_OPERATION(OperationRead);
+
+    Byte *destination = static_cast<Byte *>(buffer);
+
+    ssize_t bytesRead = readMemory(processID, sourceAddress, destination, bytesCount);
+
+    // process_vm_readv() may be unavailable, forbidden or stop at an unreadable page; read the rest word by word.
+    if(bytesRead < 0)
+        bytesRead = 0;
 
-    Register *data = reinterpret_cast<Register *>(vector.data());
+    sourceAddress += bytesRead;
+    destination += bytesRead;
+    bytesCount -= bytesRead;
 
     while(bytesCount > 0) {
-        *data++ = copyFrom(sourceAddress);
+        // Read only aligned words, so we never touch the page after the last requested byte.
+        const MemoryAddress alignedAddress = sourceAddress & ~static_cast<MemoryAddress>(sizeof(Register)-1);
+        const size_t offset = sourceAddress - alignedAddress;
+        const size_t bytesToCopy = std::min(sizeof(Register) - offset, bytesCount);
 
-        sourceAddress+=sizeof(Register);
-        bytesToRead-=sizeof(Register);
+        Register word = copyFrom(alignedAddress);
+
+        std::memcpy(destination, reinterpret_cast<Byte *>(&word) + offset, bytesToCopy);
+
+        sourceAddress += bytesToCopy;
+        destination += bytesToCopy;
+        bytesCount -= bytesToCopy;
     }
+}
 
-    return vector;
+ssize_t Process::readMemory(ProcessID processID, MemoryAddress sourceAddress, void *buffer, size_t bytesCount)
+{
+    PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestVmRead);
+
+    iovec local{ buffer, bytesCount };
+    iovec remote{ reinterpret_cast<void *>(sourceAddress), bytesCount };
+
+    return ::process_vm_readv(processID, &local, 1, &remote, 1, 0);
+}
+
+ssize_t Process::writeMemory(ProcessID processID, MemoryAddress destinationAddress, const void *buffer, size_t bytesCount)
+{
+    PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestVmWrite);
+
+    iovec local{ const_cast<void *>(buffer), bytesCount };
+    iovec remote{ reinterpret_cast<void *>(destinationAddress), bytesCount };
+
+    return ::process_vm_writev(processID, &local, 1, &remote, 1, 0);
+}
+
+Process::MemoryAddress Process::getStackPointer(const ProcessRegisters &processRegisters)
+{
+#ifdef __x86_64__
+    return processRegisters.rsp;
+#elif defined __i386__
+    return processRegisters.esp;
+#else
+# error "Your arch is not supported by Process"
+#endif
+}
+
+void Process::setStackPointer(ProcessRegisters &processRegisters, MemoryAddress stackPointer)
+{
+#ifdef __x86_64__
+    processRegisters.rsp = stackPointer;
+#elif defined __i386__
+    processRegisters.esp = stackPointer;
+#else
+# error "Your arch is not supported by Process"
+#endif
 }
 
 Process::Register Process::copyFrom(MemoryAddress sourceAddress)
 {
+    PROCESS_INSTRUMENT_OPERATION(OperationRead);
+
     return ptrace(PTRACE_PEEKDATA, sourceAddress, 0); // @arg data is ignored here.
 }
 
 long Process::ptrace(__ptrace_request request, void *addr, void *data, ProcessID pid) {
+    PROCESS_INSTRUMENT_REQUEST(requestType(request));
+
+    errno = 0;
+
     long ret = ::ptrace(request, pid, addr, data);
 
     // ret may contain -1 and it will be okay (PTRACE_PEEK*)
@@ -196,16 +382,29 @@ long Process::ptrace(__ptrace_request request, void *addr, void *data, ProcessID
     return ret;
 }
 
+Process::ProcessID Process::getProcessID()
+{
+    return processID;
+}
+
 Process::ProcessID Process::programNameToProcessID(const std::string &programName) {
-    Directory directory(procPath);
-    auto entries = directory.getFiles();
+    PROCESS_INSTRUMENT_OPERATION(OperationLookup);
+
+    std::list<dirent> entries;
+
+    {
+        PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestProcfs);
+
+        Directory directory(procPath);
+        entries = directory.getFiles();
+    }
 
     for(const auto &entry : entries) {
         // Convert the directory's name to a process id.
         ProcessID processID = std::atoi(entry.d_name);
 
         // If it's not a numeric name.
-        if(processID < 0)
+        if(processID <= 0)
             continue;
 
         // Check if the process's program name is the requested name.
@@ -227,7 +426,7 @@ std::string Process::getProgramNameByCmdLine(const std::string &cmdline) {
     std::string programName = cmdline.substr(0, position);
 
     // If this is a path, keep only the file's name.
-    position = programName.find('/');
+    position = programName.rfind('/');
 
     if(position != std::string::npos)
     {
@@ -238,11 +437,15 @@ std::string Process::getProgramNameByCmdLine(const std::string &cmdline) {
 }
 
 std::string Process::gedCmdlineByProcessID(Process::ProcessID processID) {
+    PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestProcfs);
+
     std::string cmdline = procPath;
-    cmdline += processID + "/cmdline";
+    cmdline += std::to_string(processID) + "/cmdline";
 
     std::ifstream file(cmdline.c_str());
 
+    cmdline.clear();
+
     // Get the first line of /proc/processID/cmdline.
     std::getline(file, cmdline);
 
@@ -39,6 +39,7 @@
 #include <vector>
 
 #include <cstdint>
+#include <cstring>
 
 class Process
 {
@@ -79,9 +80,16 @@ public:
 
     /**
      * @brief continueAndStopOnSystemCall  Continue the process as for cont() and stop the process before and after an interrupting of a system call.
+     * @param signal  signal to send on the start (optional).
      * @note Don't call this function when the process is running.
      */
-    void continueAndStopOnSystemCall();
+    void continueAndStopOnSystemCall(int signal=0);
+
+    /**
+     * @brief setOptions  Set ptrace options (PTRACE_O_*).
+     * @param options  e.g. PTRACE_O_TRACESYSGOOD to tell system call stops from signals.
+     */
+    void setOptions(int options);
 
     /**
      * @brief wait  Wait for the process.
@@ -120,31 +128,30 @@ public:
      */
     void call(MemoryAddress address);
 
-    template<typename T>
-    void push(T value) {
-
-        auto registers = getProcessRegisters();
-
-        // Allocate some memory in the stack.
-        registers.rsp -= sizeof(T);
+    /**
+     * @brief push  Push values into the stack, as consecutive push instructions would (the last value ends on the top).
+     * The stack pointer is updated once and all the values are written with one bulk write.
+     * @return The new stack pointer.
+     */
+    template<typename... Values>
+    MemoryAddress push(const Values &... values) {
+        static_assert(sizeof...(Values) > 0, "push() requires at least one value");
 
-        setProcesssRegisters(registers);
+        Byte buffer[PackSize<Values...>::value];
 
-        Register *wordArray = reinterpret_cast<Register*>(&value);
+        packReversed(buffer + sizeof(buffer), values...);
 
-        size_t bytesToWrite=sizeof(T);
+        auto registers = getProcessRegisters();
 
-        for(size_t bytesWritten=0; bytesWritten < sizeof(T)-1; bytesWritten+=sizeof(Register))
-        {
-            move(*wordArray++, registers.rsp+bytesWritten);
-        }
+        // Allocate some memory in the stack.
+        MemoryAddress stackPointer = getStackPointer(registers) - sizeof(buffer);
 
-        if(bytesToWrite == sizeof(T)-1) {
-            Register lastWord = *reinterpret_cast<Register *>(&value) + sizeof(T)-1;
+        write(buffer, sizeof(buffer), stackPointer);
 
-            move(lastWord, registers.rsp+sizeof(T));
-        }
+        setStackPointer(registers, stackPointer);
+        setProcesssRegisters(registers);
 
+        return stackPointer;
     }
 
     /**
@@ -163,8 +170,44 @@ public:
 
     void write(const std::vector<Byte> &bytesToWrite, MemoryAddress destinationAddresss);
 
+    /**
+     * @brief write  Copy @arg bytesCount bytes from @arg buffer into the process's memory.
+     * Any (address, length) pair is fine: the aligned middle is written with one process_vm_writev() (or word by word),
+     * and only the partial words at the head and the tail are read, modified and written back.
+     * @param buffer
+     * @param bytesCount
+     * @param destinationAddress  Valid virtual process address (no alignment required).
+     */
+    void write(const void *buffer, size_t bytesCount, MemoryAddress destinationAddress);
+
     std::vector<Byte> read(MemoryAddress sourceAddress, const std::vector<Byte>::size_type &bytesCount);
 
+    /**
+     * @brief read  Copy @arg bytesCount bytes from the process's memory into @arg buffer.
+     * Uses a single process_vm_readv() when possible and falls back to word reads.
+     * @param sourceAddress  Valid virtual process address (no alignment required).
+     * @param buffer  Local buffer of at least @arg bytesCount bytes.
+     * @param bytesCount
+     */
+    void read(MemoryAddress sourceAddress, void *buffer, size_t bytesCount);
+
+    /**
+     * @brief readMemory  Copy memory from another process with process_vm_readv().
+     * Doesn't require the process to be stopped, or the caller to be the tracer's thread.
+     * @return The number of bytes copied, or -1 on error (errno is set).
+     */
+    static ssize_t readMemory(ProcessID processID, MemoryAddress sourceAddress, void *buffer, size_t bytesCount);
+
+    /**
+     * @brief writeMemory  Copy memory into another process with process_vm_writev().
+     * Unlike PTRACE_POKEDATA, it can't write into read-only pages (e.g. code).
+     * @return The number of bytes copied, or -1 on error (errno is set).
+     */
+    static ssize_t writeMemory(ProcessID processID, MemoryAddress destinationAddress, const void *buffer, size_t bytesCount);
+
+    static MemoryAddress getStackPointer(const ProcessRegisters &processRegisters);
+    static void setStackPointer(ProcessRegisters &processRegisters, MemoryAddress stackPointer);
+
     /**
      * @brief copyFrom  Copy a Word from sourceAddress and return it.
      * @param sourceAddress
@@ -181,6 +224,12 @@ public:
 
     std::string getCmdline();
 
+    /**
+     * @brief programNameToProcessID  Find a process by its program name (the file name of its cmdline's first part).
+     * @throw std::invalid_argument if there's no such process.
+     */
+    static ProcessID programNameToProcessID(const std::string &programName);
+
     struct ProcessInfo
     {
         ProcessID parentProcessID;
@@ -189,6 +238,27 @@ public:
     };
 
 private:
+    template<typename... Values>
+    struct PackSize;
+
+    static void packReversed(Byte *)
+    {
+    }
+
+    template<typename T, typename... Values>
+    static void packReversed(Byte *end, const T &value, const Values &... values) {
+        end -= sizeof(T);
+
+        std::memcpy(end, &value, sizeof(T));
+
+        packReversed(end, values...);
+    }
+
+    /**
+     * @brief writeWords  Write word by word with PTRACE_POKEDATA, read-modify-write the partial head and tail words.
+     */
+    void writeWords(const Byte *source, size_t bytesCount, MemoryAddress destinationAddress);
+
     static long ptrace(enum __ptrace_request request, void *addr, void *data, pid_t pid);
     long ptrace(__ptrace_request request, void *addr, void *data)
     {
@@ -200,7 +270,7 @@ private:
         return ptrace(request, addr, reinterpret_cast<void *>(data));
     }
 
-    Word ptrace(__ptrace_request request, MemoryAddress address, Register data)
+    long ptrace(__ptrace_request request, MemoryAddress address, Register data)
     {
         return ptrace(request, reinterpret_cast<void*>(address), reinterpret_cast<void*>(data));
     }
@@ -210,8 +280,6 @@ private:
      */
     ProcessID processID = 0xdeadbeef;
 
-    static ProcessID programNameToProcessID(const std::string &programName);
-
     static std::string getProgramNameByCmdLine(const std::string &cmdline);
     static std::string gedCmdlineByProcessID(ProcessID processID);
 
@@ -220,4 +288,16 @@ private:
     static const char procPath[];
 };
 
+template<>
+struct Process::PackSize<>
+{
+    static const size_t value = 0;
+};
+
+template<typename T, typename... Values>
+struct Process::PackSize<T, Values...>
+{
+    static const size_t value = sizeof(T) + PackSize<Values...>::value;
+};
+
 #endif // PROCESS_H
@@ -0,0 +1,225 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#ifndef REMOTEPTR_H
+#define REMOTEPTR_H
+
+#include "process.h"
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief REMOTE_FIELD_TYPE, REMOTE_FIELD_OFFSET  The type and the offsetof() of a field of the struct pointed by a RemotePtr.
+ */
+#define REMOTE_FIELD_TYPE(remotePtr, fieldName) \
+    decltype(std::declval<typename std::remove_reference<decltype(remotePtr)>::type::ValueType>().fieldName)
+
+#define REMOTE_FIELD_OFFSET(remotePtr, fieldName) \
+    offsetof(typename std::remove_reference<decltype(remotePtr)>::type::ValueType, fieldName)
+
+/**
+ * @brief REMOTE_FIELD  Read one field of the struct pointed by a RemotePtr, using a compile-time offset.
+ * @example REMOTE_FIELD(nodePtr, value)
+ */
+#define REMOTE_FIELD(remotePtr, fieldName) \
+    (remotePtr).template field<REMOTE_FIELD_TYPE(remotePtr, fieldName), REMOTE_FIELD_OFFSET(remotePtr, fieldName)>()
+
+/**
+ * @brief REMOTE_FOLLOW  Read a pointer field of the struct pointed by a RemotePtr, and return a RemotePtr to its target.
+ * @example REMOTE_FOLLOW(nodePtr, next)
+ */
+#define REMOTE_FOLLOW(remotePtr, fieldName) \
+    (remotePtr).template follow<typename std::remove_pointer<REMOTE_FIELD_TYPE(remotePtr, fieldName)>::type, \
+        REMOTE_FIELD_OFFSET(remotePtr, fieldName)>()
+
+/**
+ * @brief The RemoteValue class  A local copy of a remote object, read with one bulk read.
+ * Gives ->field access to the copy.
+ */
+template<typename T>
+class RemoteValue
+{
+public:
+    explicit RemoteValue(const T &value)
+        : mValue(value)
+    {
+    }
+
+    const T *operator ->() const { return &mValue; }
+    const T &operator *() const { return mValue; }
+
+    operator const T &() const { return mValue; }
+
+private:
+    T mValue;
+};
+
+/**
+ * @brief The RemotePtr class  A typed pointer into the process's memory.
+ * Values are read straight into stack storage; no heap allocation per access.
+ */
+template<typename T>
+class RemotePtr
+{
+    static_assert(std::is_trivially_copyable<T>::value, "RemotePtr requires a trivially copyable type");
+
+public:
+    typedef T ValueType;
+
+    RemotePtr(Process &process, Process::MemoryAddress address)
+        : mProcess(&process), mAddress(address)
+    {
+    }
+
+    Process::MemoryAddress address() const { return mAddress; }
+    bool isNull() const { return mAddress == 0; }
+
+    /**
+     * @brief get  Read the whole object.
+     */
+    T get() const {
+        T value;
+
+        mProcess->read(mAddress, &value, sizeof(T));
+
+        return value;
+    }
+
+    /**
+     * @brief fetch  Read the whole object in one bulk read and keep it, for ->field access.
+     */
+    RemoteValue<T> fetch() const { return RemoteValue<T>(get()); }
+
+    RemoteValue<T> operator *() const { return fetch(); }
+    RemoteValue<T> operator ->() const { return fetch(); }
+
+    /**
+     * @brief at  Read a field of type FieldType, @arg offset bytes from the start of the object.
+     * Prefer REMOTE_FIELD() which gets the offset from offsetof().
+     */
+    template<typename FieldType>
+    FieldType at(size_t offset) const {
+        static_assert(std::is_trivially_copyable<FieldType>::value, "The field must be trivially copyable");
+
+        FieldType value;
+
+        mProcess->read(mAddress + offset, &value, sizeof(FieldType));
+
+        return value;
+    }
+
+    /**
+     * @brief field  Read only one field, of type FieldType at @arg offset; REMOTE_FIELD() fills both in.
+     */
+    template<typename FieldType, size_t offset>
+    FieldType field() const {
+        static_assert(offset + sizeof(FieldType) <= sizeof(T), "The field is outside of T");
+
+        return at<FieldType>(offset);
+    }
+
+    /**
+     * @brief follow  Read a pointer field at @arg offset and return a RemotePtr to its target; see REMOTE_FOLLOW().
+     */
+    template<typename U, size_t offset>
+    RemotePtr<U> follow() const {
+        return RemotePtr<U>(*mProcess, reinterpret_cast<Process::MemoryAddress>(field<U *, offset>()));
+    }
+
+    RemotePtr operator +(ptrdiff_t index) const { return RemotePtr(*mProcess, mAddress + index*sizeof(T)); }
+    RemotePtr operator -(ptrdiff_t index) const { return RemotePtr(*mProcess, mAddress - index*sizeof(T)); }
+
+    T operator [](ptrdiff_t index) const { return (*this + index).get(); }
+
+    bool operator ==(const RemotePtr &another) const { return mAddress == another.mAddress; }
+    bool operator !=(const RemotePtr &another) const { return mAddress != another.mAddress; }
+
+private:
+    Process *mProcess;
+    Process::MemoryAddress mAddress;
+};
+
+/**
+ * @brief The RemoteArray class  A typed, sized array in the process's memory.
+ * Prefetching reads the whole range (or a slice of it) with one bulk read.
+ */
+template<typename T>
+class RemoteArray
+{
+    static_assert(std::is_trivially_copyable<T>::value, "RemoteArray requires a trivially copyable type");
+
+public:
+    typedef T ValueType;
+
+    RemoteArray(Process &process, Process::MemoryAddress address, size_t size)
+        : mProcess(&process), mAddress(address), mSize(size)
+    {
+    }
+
+    Process::MemoryAddress address() const { return mAddress; }
+    size_t size() const { return mSize; }
+
+    RemotePtr<T> operator [](size_t index) const { return RemotePtr<T>(*mProcess, mAddress + index*sizeof(T)); }
+
+    T at(size_t index) const {
+        if(index >= mSize)
+            throw std::out_of_range("RemoteArray::at: index out of range");
+
+        return (*this)[index].get();
+    }
+
+    /**
+     * @brief fetch  Read @arg count elements starting at @arg first into @arg destination, with one bulk read.
+     */
+    void fetch(T *destination, size_t first, size_t count) const {
+        if(first > mSize || count > mSize - first)
+            throw std::out_of_range("RemoteArray::fetch: range out of range");
+
+        mProcess->read(mAddress + first*sizeof(T), destination, count*sizeof(T));
+    }
+
+    /**
+     * @brief fetch  Read the whole array with one bulk read.
+     */
+    std::vector<T> fetch() const {
+        std::vector<T> elements(mSize);
+
+        fetch(elements.data(), 0, mSize);
+
+        return elements;
+    }
+
+private:
+    Process *mProcess;
+    Process::MemoryAddress mAddress;
+    size_t mSize;
+};
+
+#endif // REMOTEPTR_H
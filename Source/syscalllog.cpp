@@ -0,0 +1,357 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#include "syscalllog.h"
+#include "varint.h"
+
+#include <chrono>
+#include <stdexcept>
+
+namespace {
+
+const char logMagic[] = { 'P', 'S', 'C', 'L', 2 };
+
+/**
+ * @brief difference  @arg value - @arg previous, computed unsigned so that it wraps around instead of overflowing.
+ */
+int64_t difference(int64_t value, int64_t previous)
+{
+    return static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(previous));
+}
+
+/**
+ * @brief addDelta  The inverse of difference().
+ */
+int64_t addDelta(int64_t previous, int64_t delta)
+{
+    return static_cast<int64_t>(static_cast<uint64_t>(previous) + static_cast<uint64_t>(delta));
+}
+
+size_t roundUpToPowerOfTwo(size_t value)
+{
+    size_t result = 1;
+
+    while(result < value)
+        result <<= 1;
+
+    return result;
+}
+
+}
+
+void SyscallRecord::encode(std::vector<uint8_t> &output, DeltaState &deltaState) const
+{
+    Varint::encode(number, output);
+
+    // Arguments repeat a lot between calls (same fd, nearby buffers), so deltas stay short.
+    for(unsigned int i = 0; i < argumentsCount; ++i) {
+        Varint::encodeSigned(difference(arguments[i], deltaState.previousArguments[i]), output);
+
+        deltaState.previousArguments[i] = arguments[i];
+    }
+
+    Varint::encodeSigned(returnValue, output);
+    Varint::encode(buffers.size(), output);
+
+    for(const auto &buffer : buffers) {
+        Varint::encodeSigned(difference(buffer.address, deltaState.previousAddress), output);
+        Varint::encode((buffer.bytes.size() << 2) | (buffer.isTruncated << 1) | buffer.isOutput, output);
+
+        output.insert(output.end(), buffer.bytes.begin(), buffer.bytes.end());
+
+        deltaState.previousAddress = buffer.address;
+    }
+}
+
+bool SyscallRecord::decode(const uint8_t *position, const uint8_t *end, DeltaState &deltaState)
+{
+    uint64_t value;
+    int64_t delta;
+
+    if(!Varint::decode(position, end, value))
+        return false;
+
+    number = value;
+
+    for(unsigned int i = 0; i < argumentsCount; ++i) {
+        if(!Varint::decodeSigned(position, end, delta))
+            return false;
+
+        arguments[i] = addDelta(deltaState.previousArguments[i], delta);
+        deltaState.previousArguments[i] = arguments[i];
+    }
+
+    if(!Varint::decodeSigned(position, end, delta))
+        return false;
+
+    returnValue = delta;
+
+    uint64_t buffersCount;
+
+    if(!Varint::decode(position, end, buffersCount))
+        return false;
+
+    buffers.resize(buffersCount);
+
+    for(auto &buffer : buffers) {
+        if(!Varint::decodeSigned(position, end, delta) || !Varint::decode(position, end, value))
+            return false;
+
+        const uint64_t length = value >> 2;
+
+        if(length > static_cast<uint64_t>(end - position))
+            return false;
+
+        buffer.address = addDelta(deltaState.previousAddress, delta);
+        buffer.isOutput = value & 1;
+        buffer.isTruncated = value & 2;
+        buffer.bytes.assign(position, position + length);
+
+        position += length;
+        deltaState.previousAddress = buffer.address;
+    }
+
+    return position == end;
+}
+
+SyscallLogWriter::Ring::Ring(SyscallLogWriter &writer, uint32_t streamID, size_t capacity)
+    : writer(writer), streamID(streamID), mData(roundUpToPowerOfTwo(capacity)), mask(mData.size()-1), head(0), tail(0)
+{
+}
+
+void SyscallLogWriter::Ring::append(const SyscallRecord &record)
+{
+    payload.clear();
+    record.encode(payload, deltaState);
+
+    frame.clear();
+    Varint::encode(streamID, frame);
+    Varint::encode(payload.size(), frame);
+    frame.insert(frame.end(), payload.begin(), payload.end());
+
+    appendFrame(frame);
+}
+
+void SyscallLogWriter::Ring::appendFrame(const std::vector<uint8_t> &frame)
+{
+    if(frame.size() > mData.size())
+        throw std::length_error("SyscallLogWriter: the record is bigger than the ring buffer");
+
+    const size_t position = tail.load(std::memory_order_relaxed);
+
+    // Full: wake the writer and wait for it to make room.
+    while(mData.size() - (position - head.load(std::memory_order_acquire)) < frame.size()) {
+        writer.mCondition.notify_one();
+
+        std::this_thread::yield();
+    }
+
+    const size_t offset = position & mask;
+    const size_t firstPart = std::min(frame.size(), mData.size() - offset);
+
+    std::copy(frame.begin(), frame.begin() + firstPart, mData.begin() + offset);
+    std::copy(frame.begin() + firstPart, frame.end(), mData.begin());
+
+    tail.store(position + frame.size(), std::memory_order_release);
+
+    // Don't wake the writer for every frame, only when a good part of the ring is used.
+    if(position + frame.size() - head.load(std::memory_order_relaxed) > mData.size() / 2)
+        writer.mCondition.notify_one();
+}
+
+void SyscallLogWriter::Ring::drain(FILE *file)
+{
+    const size_t first = head.load(std::memory_order_relaxed);
+    const size_t last = tail.load(std::memory_order_acquire);
+
+    if(first == last)
+        return;
+
+    const size_t offset = first & mask;
+    const size_t firstPart = std::min(last - first, mData.size() - offset);
+
+    std::fwrite(mData.data() + offset, 1, firstPart, file);
+    std::fwrite(mData.data(), 1, last - first - firstPart, file);
+
+    head.store(last, std::memory_order_release);
+}
+
+SyscallLogWriter::SyscallLogWriter(const std::string &path, size_t ringCapacity)
+    : mFile(std::fopen(path.c_str(), "ab")), ringCapacity(ringCapacity)
+{
+    if(mFile == nullptr)
+        throw std::invalid_argument("SyscallLogWriter: can't open " + path);
+
+    if(std::ftell(mFile) == 0)
+        std::fwrite(logMagic, 1, sizeof(logMagic), mFile);
+    else {
+        // The rings of this session start from fresh delta states; so must the reader.
+        std::vector<uint8_t> marker;
+
+        Varint::encode(0, marker);
+        Varint::encode(0, marker);
+
+        std::fwrite(marker.data(), 1, marker.size(), mFile);
+    }
+
+    mThread = std::thread(&SyscallLogWriter::run, this);
+}
+
+SyscallLogWriter::~SyscallLogWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        stopFlag = true;
+    }
+
+    mCondition.notify_one();
+    mThread.join();
+
+    std::fclose(mFile);
+}
+
+SyscallLogWriter::Ring &SyscallLogWriter::createRing(uint32_t streamID)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mRings.emplace_back(*this, streamID, ringCapacity);
+
+    return mRings.back();
+}
+
+void SyscallLogWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    // Two passes: the one running now may have started before our last append.
+    const uint64_t target = drainCount + 2;
+
+    mCondition.notify_one();
+
+    mDrainedCondition.wait(lock, [this, target] { return drainCount >= target; });
+}
+
+void SyscallLogWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while(true) {
+        drainAll();
+
+        ++drainCount;
+        mDrainedCondition.notify_all();
+
+        if(stopFlag)
+            break;
+
+        mCondition.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+void SyscallLogWriter::drainAll()
+{
+    for(auto &ring : mRings)
+        ring.drain(mFile);
+
+    std::fflush(mFile);
+}
+
+SyscallLogReader::SyscallLogReader(const std::string &path)
+    : mFile(path.c_str(), std::ios::binary)
+{
+    char magic[sizeof(logMagic)];
+
+    if(!mFile.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), logMagic))
+        throw std::invalid_argument("SyscallLogReader: " + path + " isn't a syscall log");
+}
+
+bool SyscallLogReader::next(uint32_t &streamID, SyscallRecord &record)
+{
+    uint64_t value;
+    uint64_t payloadLength;
+
+    while(true) {
+        if(!readVarint(value))
+            return false;
+
+        if(!readVarint(payloadLength))
+            throw std::runtime_error("SyscallLogReader: truncated frame");
+
+        if(payloadLength != 0)
+            break;
+
+        // A session marker.
+        mDeltaStates.clear();
+    }
+
+    streamID = value;
+
+    payload.resize(payloadLength);
+
+    if(!mFile.read(reinterpret_cast<char *>(payload.data()), payloadLength))
+        throw std::runtime_error("SyscallLogReader: truncated frame");
+
+    if(!record.decode(payload.data(), payload.data() + payload.size(), mDeltaStates[streamID]))
+        throw std::runtime_error("SyscallLogReader: malformed record");
+
+    return true;
+}
+
+bool SyscallLogReader::nextOfStream(uint32_t streamID, SyscallRecord &record)
+{
+    uint32_t recordStreamID;
+
+    while(next(recordStreamID, record)) {
+        if(recordStreamID == streamID)
+            return true;
+    }
+
+    return false;
+}
+
+bool SyscallLogReader::readVarint(uint64_t &value)
+{
+    value = 0;
+
+    for(unsigned int shift = 0; shift < 64; shift += 7) {
+        const int byte = mFile.get();
+
+        if(byte == std::char_traits<char>::eof()) {
+            if(shift != 0)
+                throw std::runtime_error("SyscallLogReader: truncated frame");
+
+            return false;
+        }
+
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+        if((byte & 0x80) == 0)
+            return true;
+    }
+
+    throw std::runtime_error("SyscallLogReader: malformed varint");
+}
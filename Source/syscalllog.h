@@ -0,0 +1,202 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#ifndef SYSCALLLOG_H
+#define SYSCALLLOG_H
+
+#include "process.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The SyscallRecord struct  One system call: its number, arguments, result and the user buffers it touched.
+ */
+struct SyscallRecord
+{
+    static const unsigned int argumentsCount = 6;
+
+    struct Buffer
+    {
+        Process::MemoryAddress address;
+
+        /**
+         * @brief isOutput  The kernel wrote this buffer (it's restored on replay).
+         */
+        bool isOutput;
+
+        /**
+         * @brief isTruncated  Only the beginning of the buffer was captured.
+         */
+        bool isTruncated;
+
+        std::vector<Process::Byte> bytes;
+    };
+
+    /**
+     * @brief The DeltaState struct  The previous values of a stream; arguments and addresses are encoded as deltas from them.
+     */
+    struct DeltaState
+    {
+        Process::Register previousArguments[argumentsCount] = {};
+        Process::MemoryAddress previousAddress = 0;
+    };
+
+    long number = 0;
+    Process::Register arguments[argumentsCount] = {};
+    long returnValue = 0;
+
+    std::vector<Buffer> buffers;
+
+    void encode(std::vector<uint8_t> &output, DeltaState &deltaState) const;
+
+    /**
+     * @brief decode  Decode a record encoded by encode().
+     * @return false if the payload is malformed.
+     */
+    bool decode(const uint8_t *position, const uint8_t *end, DeltaState &deltaState);
+};
+
+/**
+ * @brief The SyscallLogWriter class  An append-only binary syscall log.
+ * Each recording thread appends frames to its own ring buffer, and a writer thread flushes them to the file.
+ *
+ * File format: the magic "PSCL" and a version byte, then frames of
+ * varint(streamID) varint(payloadLength) payload, where payload is a SyscallRecord::encode().
+ * An empty payload marks the start of a session appended to the log: the delta states of all the streams restart.
+ */
+class SyscallLogWriter
+{
+public:
+    class Ring
+    {
+    public:
+        Ring(SyscallLogWriter &writer, uint32_t streamID, size_t capacity);
+
+        uint32_t getStreamID() const { return streamID; }
+
+        /**
+         * @brief append  Encode @arg record and append it as one frame. Blocks while the ring is full.
+         */
+        void append(const SyscallRecord &record);
+
+    private:
+        friend class SyscallLogWriter;
+
+        void appendFrame(const std::vector<uint8_t> &frame);
+
+        /**
+         * @brief drain  Write the published frames to @arg file (writer thread only).
+         */
+        void drain(FILE *file);
+
+        SyscallLogWriter &writer;
+        uint32_t streamID;
+
+        std::vector<uint8_t> mData;
+        size_t mask;
+
+        // Monotonic positions; head is owned by the writer thread, tail by the recording thread.
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+
+        SyscallRecord::DeltaState deltaState;
+        std::vector<uint8_t> payload;
+        std::vector<uint8_t> frame;
+    };
+
+    /**
+     * @param path  The log file; new frames are appended to an existing log, after a session marker.
+     * @param ringCapacity  The size of each ring buffer (rounded up to a power of two).
+     */
+    explicit SyscallLogWriter(const std::string &path, size_t ringCapacity = 1 << 20);
+
+    ~SyscallLogWriter();
+
+    /**
+     * @brief createRing  Create the ring buffer of one recording thread.
+     * @param streamID  Identifies the thread's records in the log (e.g. its tid).
+     */
+    Ring &createRing(uint32_t streamID);
+
+    /**
+     * @brief flush  Wait until everything appended so far is in the file.
+     */
+    void flush();
+
+private:
+    void run();
+    void drainAll();
+
+    FILE *mFile;
+    size_t ringCapacity;
+
+    std::list<Ring> mRings;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::condition_variable mDrainedCondition;
+    std::thread mThread;
+    bool stopFlag = false;
+    uint64_t drainCount = 0;
+};
+
+/**
+ * @brief The SyscallLogReader class  Read the frames of a log written by SyscallLogWriter, in order.
+ */
+class SyscallLogReader
+{
+public:
+    explicit SyscallLogReader(const std::string &path);
+
+    /**
+     * @brief next  Read the next record of any stream.
+     * @return false at the end of the log.
+     */
+    bool next(uint32_t &streamID, SyscallRecord &record);
+
+    /**
+     * @brief nextOfStream  Read the next record of @arg streamID, skipping other streams.
+     * @return false at the end of the log.
+     */
+    bool nextOfStream(uint32_t streamID, SyscallRecord &record);
+
+private:
+    bool readVarint(uint64_t &value);
+
+    std::ifstream mFile;
+    std::map<uint32_t, SyscallRecord::DeltaState> mDeltaStates;
+    std::vector<uint8_t> payload;
+};
+
+#endif // SYSCALLLOG_H
@@ -0,0 +1,411 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#include "syscallrecorder.h"
+
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const int returnValueLength = -1;
+
+/**
+ * @brief The BufferSpecification struct  Where a system call keeps a user buffer, and how long it is.
+ */
+struct BufferSpecification
+{
+    long number;
+    unsigned int addressArgument;
+
+    /**
+     * @brief lengthArgument  The argument holding the length, or returnValueLength.
+     */
+    int lengthArgument;
+    size_t fixedLength;
+
+    /**
+     * @brief capacityArgument  The argument holding the size of an output buffer filled up to the return value, or -1.
+     */
+    int capacityArgument;
+
+    bool isOutput;
+};
+
+const BufferSpecification bufferSpecifications[] = {
+    { SYS_read, 1, returnValueLength, 0, 2, true },
+    { SYS_pread64, 1, returnValueLength, 0, 2, true },
+    { SYS_readlink, 1, returnValueLength, 0, 2, true },
+    { SYS_getdents64, 1, returnValueLength, 0, 2, true },
+#ifdef SYS_recvfrom
+    { SYS_recvfrom, 1, returnValueLength, 0, 2, true },
+#endif
+#ifdef SYS_getrandom
+    { SYS_getrandom, 0, returnValueLength, 0, 1, true },
+#endif
+#ifdef SYS_stat
+    { SYS_stat, 1, 0, sizeof(struct stat), -1, true },
+#endif
+#ifdef SYS_lstat
+    { SYS_lstat, 1, 0, sizeof(struct stat), -1, true },
+#endif
+    { SYS_fstat, 1, 0, sizeof(struct stat), -1, true },
+#ifdef SYS_newfstatat
+    { SYS_newfstatat, 2, 0, sizeof(struct stat), -1, true },
+#endif
+    { SYS_clock_gettime, 1, 0, sizeof(timespec), -1, true },
+    { SYS_gettimeofday, 0, 0, sizeof(timeval), -1, true },
+    { SYS_write, 1, 2, 0, -1, false },
+    { SYS_pwrite64, 1, 2, 0, -1, false },
+#ifdef SYS_sendto
+    { SYS_sendto, 1, 2, 0, -1, false },
+#endif
+};
+
+const long passthroughSyscalls[] = {
+    SYS_exit, SYS_exit_group, SYS_execve,
+    SYS_clone, SYS_fork, SYS_vfork,
+    SYS_brk, SYS_mmap, SYS_munmap, SYS_mremap, SYS_mprotect, SYS_madvise,
+    SYS_rt_sigreturn, SYS_rt_sigaction, SYS_rt_sigprocmask,
+    SYS_futex, SYS_set_tid_address, SYS_set_robust_list,
+#ifdef SYS_arch_prctl
+    SYS_arch_prctl,
+#endif
+};
+
+long getSyscallNumber(const Process::ProcessRegisters &registers)
+{
+#ifdef __x86_64__
+    return registers.orig_rax;
+#elif defined __i386__
+    return registers.orig_eax;
+#else
+# error "Your arch is not supported by Process"
+#endif
+}
+
+void setSyscallNumber(Process::ProcessRegisters &registers, long number)
+{
+#ifdef __x86_64__
+    registers.orig_rax = number;
+#elif defined __i386__
+    registers.orig_eax = number;
+#endif
+}
+
+void getSyscallArguments(const Process::ProcessRegisters &registers, Process::Register *arguments)
+{
+#ifdef __x86_64__
+    const Process::Register values[] = { Process::Register(registers.rdi), Process::Register(registers.rsi), Process::Register(registers.rdx),
+                                         Process::Register(registers.r10), Process::Register(registers.r8), Process::Register(registers.r9) };
+#elif defined __i386__
+    const Process::Register values[] = { registers.ebx, registers.ecx, registers.edx,
+                                         registers.esi, registers.edi, registers.ebp };
+#endif
+
+    std::copy(values, values + SyscallRecord::argumentsCount, arguments);
+}
+
+long getReturnValue(const Process::ProcessRegisters &registers)
+{
+#ifdef __x86_64__
+    return registers.rax;
+#elif defined __i386__
+    return registers.eax;
+#endif
+}
+
+void setReturnValue(Process::ProcessRegisters &registers, long returnValue)
+{
+#ifdef __x86_64__
+    registers.rax = returnValue;
+#elif defined __i386__
+    registers.eax = returnValue;
+#endif
+}
+
+/**
+ * @brief findSpecification  The specification @arg buffer of @arg record was captured with.
+ * @return nullptr if there's none.
+ */
+const BufferSpecification *findSpecification(const SyscallRecord &record, const SyscallRecord::Buffer &buffer)
+{
+    for(const auto &specification : bufferSpecifications) {
+        if(specification.number == record.number && specification.isOutput == buffer.isOutput &&
+                static_cast<Process::MemoryAddress>(record.arguments[specification.addressArgument]) == buffer.address)
+            return &specification;
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief tracingOptions  Syscall stops are told apart from signals, and execve() reports an event instead of a SIGTRAP.
+ */
+const int tracingOptions = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEEXEC;
+
+/**
+ * @brief waitForSyscallStop  Continue the process until the next system call stop (entry or exit).
+ * Requires tracingOptions. Ptrace event stops (e.g. after an execve()) are skipped; other stops are signals,
+ * which are delivered on the next continue.
+ * @return false if the process exited.
+ */
+bool waitForSyscallStop(Process &process)
+{
+    int signal = 0;
+
+    while(true) {
+        process.continueAndStopOnSystemCall(signal);
+
+        const int status = process.wait();
+
+        if(WIFEXITED(status) || WIFSIGNALED(status))
+            return false;
+
+        if(WSTOPSIG(status) == (SIGTRAP | 0x80))
+            return true;
+
+        signal = (status >> 16) != 0 ? 0 : WSTOPSIG(status);
+    }
+}
+
+}
+
+SyscallRecorder::SyscallRecorder(Process &process, SyscallLogWriter &log)
+    : process(process), ring(log.createRing(process.getProcessID())), mStatistics()
+{
+    process.setOptions(tracingOptions);
+}
+
+bool SyscallRecorder::recordNext()
+{
+    if(!waitForSyscallStop(process))
+        return false;
+
+    auto startTime = Clock::now();
+
+    auto registers = process.getProcessRegisters();
+
+    record.number = getSyscallNumber(registers);
+    getSyscallArguments(registers, record.arguments);
+
+    auto overhead = Clock::now() - startTime;
+
+    // The call ended the process (e.g. exit_group); keep it in the log so a replay lines up.
+    if(!waitForSyscallStop(process)) {
+        record.returnValue = 0;
+        record.buffers.clear();
+
+        ring.append(record);
+
+        return false;
+    }
+
+    startTime = Clock::now();
+
+    record.returnValue = getReturnValue(process.getProcessRegisters());
+
+    captureBuffers();
+
+    ring.append(record);
+
+    overhead += Clock::now() - startTime;
+
+    const uint64_t overheadNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(overhead).count();
+
+    ++mStatistics.syscalls;
+    mStatistics.totalOverhead += overheadNanoseconds;
+    mStatistics.maximumOverhead = std::max(mStatistics.maximumOverhead, overheadNanoseconds);
+
+    if(overhead > budget)
+        ++mStatistics.overBudget;
+
+    return true;
+}
+
+void SyscallRecorder::setBudget(std::chrono::nanoseconds budget)
+{
+    this->budget = budget;
+}
+
+void SyscallRecorder::setMaximumCaptureBytes(size_t maximumCaptureBytes)
+{
+    this->maximumCaptureBytes = maximumCaptureBytes;
+}
+
+SyscallRecorder::Statistics SyscallRecorder::getStatistics() const
+{
+    return mStatistics;
+}
+
+void SyscallRecorder::captureBuffers()
+{
+    size_t buffersCount = 0;
+
+    for(const auto &specification : bufferSpecifications) {
+        if(specification.number != record.number)
+            continue;
+
+        // Failed calls don't touch their output buffers.
+        if(specification.isOutput && record.returnValue < 0)
+            continue;
+
+        size_t length = specification.fixedLength;
+
+        if(specification.lengthArgument == returnValueLength)
+            length = record.returnValue;
+        else if(specification.fixedLength == 0)
+            length = record.arguments[specification.lengthArgument];
+
+        const Process::MemoryAddress address = record.arguments[specification.addressArgument];
+
+        if(address == 0 || length == 0)
+            continue;
+
+        const bool isTruncated = length > maximumCaptureBytes;
+
+        length = std::min(length, maximumCaptureBytes);
+
+        // Reuse the buffers of the previous record, they're usually the same size.
+        if(record.buffers.size() <= buffersCount)
+            record.buffers.resize(buffersCount+1);
+
+        auto &buffer = record.buffers[buffersCount++];
+
+        buffer.address = address;
+        buffer.isOutput = specification.isOutput;
+        buffer.isTruncated = isTruncated;
+        buffer.bytes.resize(length);
+
+        process.read(address, buffer.bytes.data(), length);
+
+        mStatistics.capturedBytes += length;
+        mStatistics.truncatedBuffers += isTruncated;
+    }
+
+    record.buffers.resize(buffersCount);
+}
+
+SyscallReplayer::SyscallReplayer(Process &process, SyscallLogReader &log, uint32_t streamID)
+    : process(process), log(log), streamID(streamID)
+{
+    process.setOptions(tracingOptions);
+}
+
+bool SyscallReplayer::replayNext()
+{
+    if(!waitForSyscallStop(process))
+        return false;
+
+    auto registers = process.getProcessRegisters();
+    const long number = getSyscallNumber(registers);
+
+    if(!log.nextOfStream(streamID, record))
+        throw std::runtime_error("replay: the log ended");
+
+    if(record.number != number)
+        throw std::runtime_error("replay: diverged, recorded system call " + std::to_string(record.number) + ", got " + std::to_string(number));
+
+    const bool emulate = !isPassthrough(number);
+
+    // The rest of the buffer would be left as it is, while the recorded result claims it was written.
+    for(const auto &buffer : record.buffers) {
+        if(emulate && buffer.isOutput && buffer.isTruncated)
+            throw std::runtime_error("replay: the output of recorded system call " + std::to_string(number) + " was truncated when recording");
+    }
+
+    // The outputs go where the live call wants them, which may differ from the recording (ASLR, another heap state).
+    destinations.clear();
+
+    if(emulate) {
+        Process::Register arguments[SyscallRecord::argumentsCount];
+
+        getSyscallArguments(registers, arguments);
+
+        for(const auto &buffer : record.buffers) {
+            if(!buffer.isOutput)
+                continue;
+
+            const BufferSpecification *specification = findSpecification(record, buffer);
+
+            if(specification == nullptr)
+                throw std::runtime_error("replay: no output buffer of system call " + std::to_string(number) + " was expected");
+
+            const size_t capacity = specification->capacityArgument < 0 ? specification->fixedLength
+                                                                        : arguments[specification->capacityArgument];
+            const bool fits = specification->capacityArgument < 0 ? buffer.bytes.size() == capacity : buffer.bytes.size() <= capacity;
+
+            if(!fits)
+                throw std::runtime_error("replay: diverged, recorded " + std::to_string(buffer.bytes.size()) + " bytes of output for system call " +
+                                         std::to_string(number) + ", the live buffer has " + std::to_string(capacity));
+
+            destinations.push_back(arguments[specification->addressArgument]);
+        }
+    }
+
+    // An invalid system call number makes the kernel skip the call.
+    if(emulate) {
+        setSyscallNumber(registers, -1);
+
+        process.setProcesssRegisters(registers);
+    }
+
+    if(!waitForSyscallStop(process))
+        return false;
+
+    if(emulate) {
+        registers = process.getProcessRegisters();
+
+        setReturnValue(registers, record.returnValue);
+
+        process.setProcesssRegisters(registers);
+
+        auto destination = destinations.begin();
+
+        for(const auto &buffer : record.buffers) {
+            if(buffer.isOutput)
+                process.write(buffer.bytes.data(), buffer.bytes.size(), *destination++);
+        }
+    }
+
+    return true;
+}
+
+bool SyscallReplayer::isPassthrough(long number)
+{
+    for(long passthroughNumber : passthroughSyscalls) {
+        if(passthroughNumber == number)
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#ifndef SYSCALLRECORDER_H
+#define SYSCALLRECORDER_H
+
+#include "process.h"
+#include "syscalllog.h"
+
+#include <chrono>
+
+/**
+ * @brief The SyscallRecorder class  Record the system calls of a process into a SyscallLogWriter.
+ * Every call's number, arguments and result are recorded, with the user buffers of the known
+ * read/write-like calls (read with one bulk read each).
+ */
+class SyscallRecorder
+{
+public:
+    struct Statistics
+    {
+        uint64_t syscalls;
+        uint64_t capturedBytes;
+
+        /**
+         * @brief truncatedBuffers  Buffers longer than the capture limit; the calls that output them can't be replayed.
+         */
+        uint64_t truncatedBuffers;
+
+        /**
+         * @brief totalOverhead  Time spent by the recorder itself (registers, buffers, encoding), in nanoseconds.
+         */
+        uint64_t totalOverhead;
+        uint64_t maximumOverhead;
+
+        /**
+         * @brief overBudget  How many calls took more than the budget to record.
+         */
+        uint64_t overBudget;
+    };
+
+    /**
+     * @param process  A stopped, attached process.
+     * @param log  The records go to a ring of this log, with the process ID as the stream ID.
+     */
+    SyscallRecorder(Process &process, SyscallLogWriter &log);
+
+    /**
+     * @brief recordNext  Run the process until the end of the next system call, and record it.
+     * Signals that stop the process on the way are delivered to it.
+     * @return false if the process exited.
+     */
+    bool recordNext();
+
+    /**
+     * @brief setBudget  The recording time allowed per call, counted in Statistics::overBudget.
+     */
+    void setBudget(std::chrono::nanoseconds budget);
+
+    /**
+     * @brief setMaximumCaptureBytes  Bound the bytes captured per buffer, which bounds the recording time per call.
+     * Buffers cut short are marked truncated; to replay a recording, set a limit above the biggest output buffer.
+     */
+    void setMaximumCaptureBytes(size_t maximumCaptureBytes);
+
+    Statistics getStatistics() const;
+
+    static const size_t defaultMaximumCaptureBytes = 64*1024;
+
+private:
+    void captureBuffers();
+
+    Process &process;
+    SyscallLogWriter::Ring &ring;
+
+    std::chrono::nanoseconds budget = std::chrono::microseconds(20);
+    size_t maximumCaptureBytes = defaultMaximumCaptureBytes;
+
+    SyscallRecord record;
+    Statistics mStatistics;
+};
+
+/**
+ * @brief The SyscallReplayer class  Feed the results of a recorded run back to a process.
+ * Recorded calls are skipped and their return values and output buffers are written instead; calls that manage
+ * the process itself (memory mapping, threads, signals, exit) still run for real.
+ */
+class SyscallReplayer
+{
+public:
+    /**
+     * @param process  A stopped, attached process, at the same point the recording started.
+     * @param log
+     * @param streamID  The recorded stream to replay (the recorded process ID).
+     */
+    SyscallReplayer(Process &process, SyscallLogReader &log, uint32_t streamID);
+
+    /**
+     * @brief replayNext  Run the process until the end of the next system call, and replace its result by the recorded one.
+     * @return false if the process exited.
+     * @throw std::runtime_error if the process made another call than the recorded one, the log ended, or an output
+     * buffer of the call was truncated when recording.
+     */
+    bool replayNext();
+
+    static bool isPassthrough(long number);
+
+private:
+    Process &process;
+    SyscallLogReader &log;
+    uint32_t streamID;
+
+    SyscallRecord record;
+
+    /**
+     * @brief destinations  Where the output buffers of the call being replayed go, in the live process.
+     */
+    std::vector<Process::MemoryAddress> destinations;
+};
+
+#endif // SYSCALLRECORDER_H
@@ -0,0 +1,506 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+
+#include "threadgroup.h"
+#include "directory.h"
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <set>
+#include <stdexcept>
+
+#include <sys/wait.h>
+
+namespace {
+
+/**
+ * @brief waitOptions  Only the tracees of the calling (tracer) thread, not the children of the other threads.
+ */
+const int waitOptions = __WALL | __WNOTHREAD | WNOHANG;
+
+/**
+ * @brief The pump polls with a growing interval while nothing happens; an event restarts it from the shortest.
+ */
+const std::chrono::microseconds shortestPumpInterval(10);
+const std::chrono::microseconds longestPumpInterval(1000);
+
+bool isJobControlSignal(int signal)
+{
+    return signal == SIGSTOP || signal == SIGTSTP || signal == SIGTTIN || signal == SIGTTOU;
+}
+
+}
+
+ThreadGroup::ThreadGroup(Process::ProcessID processID)
+    : processID(processID), mStatistics()
+{
+    mTracer = std::thread(&ThreadGroup::run, this);
+
+    try {
+        execute(CommandSeize);
+    }
+    catch(...) {
+        mTracer.join();
+
+        throw;
+    }
+}
+
+ThreadGroup::~ThreadGroup()
+{
+    try {
+        execute(CommandDetach);
+    }
+    catch(const std::exception &) {
+    }
+
+    // The kernel detaches whatever is left when the tracer thread exits.
+    mTracer.join();
+}
+
+const std::vector<ThreadGroup::ThreadState> &ThreadGroup::stop(std::chrono::milliseconds timeout)
+{
+    execute(CommandStop, timeout);
+
+    return mThreads;
+}
+
+void ThreadGroup::resume()
+{
+    execute(CommandResume);
+}
+
+bool ThreadGroup::isStopped() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return stopped;
+}
+
+std::vector<Process::ProcessID> ThreadGroup::getThreadIDs() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::vector<Process::ProcessID> threadIDs;
+
+    for(const auto &thread : mThreads)
+        threadIDs.push_back(thread.threadID);
+
+    return threadIDs;
+}
+
+void ThreadGroup::execute(Command command, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    // Another thread's command runs first; don't overwrite it or its error.
+    mDoneCondition.wait(lock, [this] { return !commandBusy; });
+
+    commandBusy = true;
+    mCommand = command;
+    mError = nullptr;
+    stopTimeout = timeout;
+
+    mCommandCondition.notify_one();
+    mDoneCondition.wait(lock, [this] { return mCommand == CommandNone; });
+
+    const std::exception_ptr error = mError;
+
+    commandBusy = false;
+    mDoneCondition.notify_all();
+
+    if(error)
+        std::rethrow_exception(error);
+}
+
+void ThreadGroup::run()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    auto pumpInterval = shortestPumpInterval;
+
+    while(true) {
+        if(mCommand != CommandNone) {
+            const Command command = mCommand;
+
+            try {
+                switch(command) {
+                case CommandSeize: seize(); break;
+                case CommandStop: stopThreads(); break;
+                case CommandResume: resumeThreads(); break;
+                case CommandDetach: detach(); break;
+                case CommandNone: break;
+                }
+            }
+            catch(...) {
+                mError = std::current_exception();
+            }
+
+            const bool finished = command == CommandDetach || (command == CommandSeize && mError);
+
+            mCommand = CommandNone;
+            mDoneCondition.notify_all();
+
+            if(finished)
+                return;
+
+            pumpInterval = shortestPumpInterval;
+
+            continue;
+        }
+
+        // Stopped threads don't report anything; wait for the next command.
+        if(stopped) {
+            mCommandCondition.wait(lock, [this] { return mCommand != CommandNone; });
+
+            continue;
+        }
+
+        if(pumpEvents() > 0) {
+            pumpInterval = shortestPumpInterval;
+
+            continue;
+        }
+
+        mCommandCondition.wait_for(lock, pumpInterval, [this] { return mCommand != CommandNone; });
+
+        pumpInterval = std::min(pumpInterval * 2, longestPumpInterval);
+    }
+}
+
+void ThreadGroup::seize()
+{
+    PROCESS_INSTRUMENT_OPERATION(OperationAttach);
+
+    // Threads may start while we seize the others; those started by seized threads are followed by TRACECLONE.
+    while(seizeThreads() > 0)
+        ;
+
+    if(mThreads.empty())
+        throw std::invalid_argument("ThreadGroup: can't seize any thread of the process");
+}
+
+void ThreadGroup::stopThreads()
+{
+    PROCESS_INSTRUMENT_OPERATION(OperationStop);
+
+    if(stopped)
+        return;
+
+    const auto startTime = Clock::now();
+    const auto deadline = startTime + stopTimeout;
+
+    std::set<Process::ProcessID> waiting;
+
+    // Interrupt everybody first, so they all stop in parallel.
+    for(size_t index = 0; index < mThreads.size(); ) {
+        PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestPtraceOther);
+
+        mThreads[index].pendingSignal = 0;
+        mThreads[index].isGroupStopped = false;
+
+        if(::ptrace(PTRACE_INTERRUPT, mThreads[index].threadID, nullptr, nullptr) < 0 && errno == ESRCH) {
+            removeThread(index);
+
+            continue;
+        }
+
+        waiting.insert(mThreads[index].threadID);
+        ++index;
+    }
+
+    const auto interruptedTime = Clock::now();
+
+    // Collect the stops as they come, whichever thread reports first.
+    while(!waiting.empty()) {
+        int status;
+        Process::ProcessID threadID;
+
+        {
+            PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestWaitpid);
+
+            threadID = ::waitpid(-1, &status, waitOptions);
+        }
+
+        // No tracee left at all.
+        if(threadID < 0 && errno == ECHILD) {
+            mThreads.clear();
+
+            break;
+        }
+
+        if(threadID <= 0) {
+            if(Clock::now() > deadline) {
+                const size_t missingCount = waiting.size();
+
+                // Don't leave the threads that did stop frozen; the others get their interrupt stop serviced later.
+                for(auto &thread : mThreads) {
+                    if(waiting.count(thread.threadID) == 0)
+                        continueThread(thread);
+                }
+
+                throw std::runtime_error("ThreadGroup::stop: " + std::to_string(missingCount) + " threads didn't stop in time");
+            }
+
+            std::this_thread::yield();
+
+            continue;
+        }
+
+        if(WIFEXITED(status) || WIFSIGNALED(status)) {
+            const size_t index = findThread(threadID);
+
+            if(index < mThreads.size())
+                removeThread(index);
+
+            waiting.erase(threadID);
+
+            continue;
+        }
+
+        if(!WIFSTOPPED(status))
+            continue;
+
+        // A thread whose clone event we didn't see yet reports its first stop.
+        const size_t index = addThread(threadID);
+        const int event = status >> 16;
+
+        if(event == PTRACE_EVENT_CLONE) {
+            unsigned long newThreadID;
+
+            ::ptrace(PTRACE_GETEVENTMSG, threadID, nullptr, &newThreadID);
+
+            // The new thread starts in a stop of its own, unless it reported it already.
+            if(findThread(newThreadID) == mThreads.size()) {
+                addThread(newThreadID);
+                waiting.insert(newThreadID);
+            }
+
+            // The thread got the interrupt while cloning; it still owes us the interrupt stop.
+            ::ptrace(PTRACE_CONT, threadID, nullptr, nullptr);
+            ::ptrace(PTRACE_INTERRUPT, threadID, nullptr, nullptr);
+
+            continue;
+        }
+
+        ThreadState &thread = mThreads[index];
+
+        // A signal-delivery stop instead of the interrupt stop: stopped all the same, keep the signal for resume().
+        // The interrupt is still pending; its stop comes after resume(), and the pump continues it.
+        if(event == 0)
+            thread.pendingSignal = WSTOPSIG(status);
+        else if(event == PTRACE_EVENT_STOP)
+            thread.isGroupStopped = isJobControlSignal(WSTOPSIG(status));
+
+        waiting.erase(threadID);
+    }
+
+    const auto collectedTime = Clock::now();
+
+    // Every thread is stopped now: read all the registers in one pass.
+    for(auto &thread : mThreads) {
+        PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestPtraceRegisters);
+
+        ::ptrace(PTRACE_GETREGS, thread.threadID, nullptr, &thread.registers);
+    }
+
+    const auto endTime = Clock::now();
+
+    stopped = true;
+    stopTime = startTime;
+
+    mStatistics.threadsCount = mThreads.size();
+    mStatistics.interruptTime = interruptedTime - startTime;
+    mStatistics.collectTime = collectedTime - interruptedTime;
+    mStatistics.registersTime = endTime - collectedTime;
+    mStatistics.stopTime = endTime - startTime;
+}
+
+void ThreadGroup::resumeThreads()
+{
+    PROCESS_INSTRUMENT_OPERATION(OperationContinue);
+
+    if(!stopped)
+        return;
+
+    const auto startTime = Clock::now();
+
+    for(auto &thread : mThreads)
+        continueThread(thread);
+
+    const auto endTime = Clock::now();
+
+    stopped = false;
+
+    mStatistics.resumeTime = endTime - startTime;
+    mStatistics.pauseTime = endTime - stopTime;
+}
+
+void ThreadGroup::detach()
+{
+    PROCESS_INSTRUMENT_OPERATION(OperationDetach);
+
+    // Only a stopped thread can be detached.
+    stopThreads();
+
+    for(const auto &thread : mThreads) {
+        PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestPtraceAttach);
+
+        ::ptrace(PTRACE_DETACH, thread.threadID, nullptr, reinterpret_cast<void *>(static_cast<long>(thread.pendingSignal)));
+    }
+
+    mThreads.clear();
+}
+
+size_t ThreadGroup::seizeThreads()
+{
+    std::list<dirent> entries;
+
+    {
+        PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestProcfs);
+
+        Directory directory(std::string("/proc/") + std::to_string(processID) + "/task");
+        entries = directory.getFiles();
+    }
+
+    size_t seizedCount = 0;
+
+    for(const auto &entry : entries) {
+        const Process::ProcessID threadID = std::atoi(entry.d_name);
+
+        if(threadID <= 0 || findThread(threadID) < mThreads.size())
+            continue;
+
+        PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestPtraceAttach);
+
+        // It may have exited since the listing.
+        if(::ptrace(PTRACE_SEIZE, threadID, nullptr, reinterpret_cast<void *>(PTRACE_O_TRACECLONE)) < 0)
+            continue;
+
+        mThreads.push_back(ThreadState{ threadID, Process::ProcessRegisters(), 0, false });
+
+        ++seizedCount;
+    }
+
+    return seizedCount;
+}
+
+size_t ThreadGroup::pumpEvents()
+{
+    size_t eventsCount = 0;
+
+    while(true) {
+        int status;
+        Process::ProcessID threadID;
+
+        {
+            PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestWaitpid);
+
+            threadID = ::waitpid(-1, &status, waitOptions);
+        }
+
+        if(threadID <= 0)
+            return eventsCount;
+
+        ++eventsCount;
+
+        if(WIFEXITED(status) || WIFSIGNALED(status)) {
+            const size_t index = findThread(threadID);
+
+            if(index < mThreads.size())
+                removeThread(index);
+
+            continue;
+        }
+
+        if(!WIFSTOPPED(status))
+            continue;
+
+        const size_t index = addThread(threadID);
+        const int event = status >> 16;
+
+        if(event == PTRACE_EVENT_CLONE) {
+            unsigned long newThreadID;
+
+            ::ptrace(PTRACE_GETEVENTMSG, threadID, nullptr, &newThreadID);
+
+            addThread(newThreadID);
+        }
+
+        ThreadState &thread = mThreads[index];
+
+        thread.pendingSignal = 0;
+        thread.isGroupStopped = false;
+
+        // Signal-delivery stops get their signal; a job control stop keeps the thread stopped until SIGCONT.
+        // Anything else (clone events, first stops of new threads, late interrupt stops) just goes on.
+        if(event == 0)
+            thread.pendingSignal = WSTOPSIG(status);
+        else if(event == PTRACE_EVENT_STOP)
+            thread.isGroupStopped = isJobControlSignal(WSTOPSIG(status));
+
+        continueThread(thread);
+    }
+}
+
+void ThreadGroup::continueThread(ThreadState &thread)
+{
+    PROCESS_INSTRUMENT_REQUEST(Instrumentation::RequestPtraceResume);
+
+    if(thread.isGroupStopped)
+        ::ptrace(PTRACE_LISTEN, thread.threadID, nullptr, nullptr);
+    else
+        ::ptrace(PTRACE_CONT, thread.threadID, nullptr, reinterpret_cast<void *>(static_cast<long>(thread.pendingSignal)));
+
+    thread.pendingSignal = 0;
+    thread.isGroupStopped = false;
+}
+
+size_t ThreadGroup::findThread(Process::ProcessID threadID) const
+{
+    return std::find_if(mThreads.begin(), mThreads.end(), [threadID](const ThreadState &thread) {
+        return thread.threadID == threadID;
+    }) - mThreads.begin();
+}
+
+size_t ThreadGroup::addThread(Process::ProcessID threadID)
+{
+    const size_t index = findThread(threadID);
+
+    if(index == mThreads.size())
+        mThreads.push_back(ThreadState{ threadID, Process::ProcessRegisters(), 0, false });
+
+    return index;
+}
+
+void ThreadGroup::removeThread(size_t index)
+{
+    mThreads[index] = mThreads.back();
+    mThreads.pop_back();
+}
@@ -0,0 +1,201 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#ifndef THREADGROUP_H
+#define THREADGROUP_H
+
+#include "process.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The ThreadGroup class  Trace every thread of a process, and stop or resume them all together.
+ * The threads are seized (PTRACE_SEIZE) rather than attached, so they can be interrupted with PTRACE_INTERRUPT
+ * without sending a signal; new threads are followed (PTRACE_O_TRACECLONE).
+ * A tracer thread of its own makes every ptrace request. While the group runs it services the stops of the
+ * threads (clones, signal deliveries, job control), so they keep running between stop() and resume().
+ * @note Don't use it together with a Process of the same process: a thread has only one tracer.
+ */
+class ThreadGroup
+{
+public:
+    struct ThreadState
+    {
+        Process::ProcessID threadID;
+        Process::ProcessRegisters registers;
+
+        /**
+         * @brief pendingSignal  A signal the thread was about to get when it stopped; it's delivered on resume().
+         */
+        int pendingSignal;
+
+        /**
+         * @brief isGroupStopped  The thread was in a job control stop (SIGSTOP...); resume() leaves it there until SIGCONT.
+         */
+        bool isGroupStopped;
+    };
+
+    struct StopStatistics
+    {
+        size_t threadsCount;
+
+        std::chrono::nanoseconds interruptTime;
+
+        /**
+         * @brief collectTime  From the last interrupt until every thread reported its stop.
+         */
+        std::chrono::nanoseconds collectTime;
+        std::chrono::nanoseconds registersTime;
+
+        /**
+         * @brief stopTime  From the first interrupt until all the registers were read.
+         */
+        std::chrono::nanoseconds stopTime;
+        std::chrono::nanoseconds resumeTime;
+
+        /**
+         * @brief pauseTime  How long the first thread stopped stayed stopped (from stop() until the end of resume()).
+         */
+        std::chrono::nanoseconds pauseTime;
+    };
+
+    /**
+     * @brief ThreadGroup  Seize every thread in /proc/processID/task. The threads keep running.
+     * @param processID
+     */
+    explicit ThreadGroup(Process::ProcessID processID);
+
+    ~ThreadGroup();
+
+    ThreadGroup(const ThreadGroup &) = delete;
+    ThreadGroup &operator =(const ThreadGroup &) = delete;
+
+    /**
+     * @brief stop  Interrupt every thread, wait until all of them stopped, and read all their registers.
+     * @param timeout  Give up (and throw std::runtime_error) if some thread didn't stop by then; the threads
+     * that did stop are resumed.
+     * @return The state of every thread, valid until resume().
+     */
+    const std::vector<ThreadState> &stop(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+    /**
+     * @brief resume  Continue every thread stopped by stop().
+     */
+    void resume();
+
+    bool isStopped() const;
+
+    std::vector<Process::ProcessID> getThreadIDs() const;
+
+    const StopStatistics &getStopStatistics() const { return mStatistics; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Command {
+        CommandNone,
+        CommandSeize,
+        CommandStop,
+        CommandResume,
+        CommandDetach
+    };
+
+    /**
+     * @brief execute  Have the tracer thread run @arg command, and wait for it.
+     * Commands from several threads run one after the other; each caller gets its own command's error.
+     * @param timeout  How long CommandStop waits for the threads.
+     * @throw What the command threw.
+     */
+    void execute(Command command, std::chrono::milliseconds timeout = std::chrono::milliseconds::zero());
+
+    /**
+     * @brief run  The tracer thread: run the commands, and service the stops of the threads in between.
+     */
+    void run();
+
+    void seize();
+    void stopThreads();
+    void resumeThreads();
+    void detach();
+
+    /**
+     * @brief seizeThreads  Seize the threads of /proc/processID/task we don't trace yet.
+     * @return How many threads were seized.
+     */
+    size_t seizeThreads();
+
+    /**
+     * @brief pumpEvents  Collect the pending stops and continue them at once, as if the threads weren't traced.
+     * @return How many stops were handled.
+     */
+    size_t pumpEvents();
+
+    /**
+     * @brief continueThread  Restart @arg thread from its stop, with its pending signal, or listening for SIGCONT.
+     */
+    void continueThread(ThreadState &thread);
+
+    /**
+     * @brief findThread  The index of @arg threadID, or mThreads.size().
+     */
+    size_t findThread(Process::ProcessID threadID) const;
+
+    /**
+     * @brief addThread  Add a thread created by a traced one (unless known already).
+     * @return Its index.
+     */
+    size_t addThread(Process::ProcessID threadID);
+
+    void removeThread(size_t index);
+
+    Process::ProcessID processID;
+
+    std::vector<ThreadState> mThreads;
+    bool stopped = false;
+
+    std::chrono::milliseconds stopTimeout;
+
+    Clock::time_point stopTime;
+    StopStatistics mStatistics;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCommandCondition;
+    std::condition_variable mDoneCondition;
+    Command mCommand = CommandNone;
+    std::exception_ptr mError;
+
+    // Held from issuing a command until its caller took mError, so the next command waits.
+    bool commandBusy = false;
+
+    std::thread mTracer;
+};
+
+#endif // THREADGROUP_H
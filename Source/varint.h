@@ -0,0 +1,92 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ */
+
+
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The Varint class  LEB128 variable-length integers, with zigzag encoding for signed deltas.
+ */
+class Varint
+{
+public:
+    static void encode(uint64_t value, std::vector<uint8_t> &output) {
+        while(value >= 0x80) {
+            output.push_back(static_cast<uint8_t>(value) | 0x80);
+
+            value >>= 7;
+        }
+
+        output.push_back(static_cast<uint8_t>(value));
+    }
+
+    static void encodeSigned(int64_t value, std::vector<uint8_t> &output) {
+        encode(zigzag(value), output);
+    }
+
+    /**
+     * @brief decode  Decode a varint and advance @arg position past it.
+     * @return false if the input ended in the middle of the varint.
+     */
+    static bool decode(const uint8_t *&position, const uint8_t *end, uint64_t &value) {
+        value = 0;
+
+        for(unsigned int shift = 0; position < end && shift < 64; shift += 7) {
+            const uint8_t byte = *position++;
+
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+            if((byte & 0x80) == 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    static bool decodeSigned(const uint8_t *&position, const uint8_t *end, int64_t &value) {
+        uint64_t encoded;
+
+        if(!decode(position, end, encoded))
+            return false;
+
+        value = unzigzag(encoded);
+
+        return true;
+    }
+
+    static uint64_t zigzag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    static int64_t unzigzag(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+};
+
+#endif // VARINT_H
@@ -0,0 +1,294 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * A randomized test of Process::write()/read(): random (offset, length) transfers against a local copy of the
+ * tracee's memory, on a writable mapping (process_vm_writev) and on a read-only one (the PTRACE_POKEDATA fallback).
+ * Then push() and call() on a stack moved into each mapping.
+ */
+
+
+#include <process.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t areaSize = 64*1024;
+
+/**
+ * @brief The Area struct  A mapping of the tracee (mapped before the fork, so it's at the same address) and our model of it.
+ */
+struct Area
+{
+    const char *name;
+    Process::Byte *address;
+    std::vector<Process::Byte> model;
+};
+
+/**
+ * @brief randomLength  Mostly lengths around a few words, where the head/tail handling is, sometimes anything up to @arg maximum.
+ */
+size_t randomLength(std::mt19937 &random, size_t maximum)
+{
+    switch(random() % 4) {
+    case 0:
+        return random() % (maximum + 1);
+    case 1:
+        return random() % 1024;
+    default:
+        return random() % (4 * sizeof(Process::Register) + 1);
+    }
+}
+
+std::string describe(const Area &area, size_t offset, size_t length)
+{
+    return std::string(area.name) + " offset " + std::to_string(offset) + " length " + std::to_string(length);
+}
+
+/**
+ * @brief check  Read [@arg offset, @arg offset + @arg length) of the tracee and compare it to the model.
+ */
+void check(Process &process, const Area &area, size_t offset, size_t length, const std::string &after)
+{
+    std::vector<Process::Byte> bytes(length);
+
+    process.read(reinterpret_cast<Process::MemoryAddress>(area.address + offset), bytes.data(), length);
+
+    const auto mismatch = std::mismatch(bytes.begin(), bytes.end(), area.model.begin() + offset);
+
+    if(mismatch.first != bytes.end())
+        throw std::runtime_error("read " + describe(area, offset, length) + ": byte " +
+                                 std::to_string(mismatch.first - bytes.begin()) + " differs, after writing " + after);
+}
+
+void run(Process &process, std::vector<Area> &areas, std::mt19937 &random, unsigned long iterations)
+{
+    for(unsigned long iteration = 0; iteration < iterations; ++iteration) {
+        Area &area = areas[iteration % areas.size()];
+
+        const size_t length = randomLength(random, areaSize);
+        const size_t offset = random() % (areaSize - length + 1);
+
+        std::vector<Process::Byte> bytes(length);
+
+        for(auto &byte : bytes)
+            byte = random();
+
+        process.write(bytes.data(), length, reinterpret_cast<Process::MemoryAddress>(area.address + offset));
+
+        std::copy(bytes.begin(), bytes.end(), area.model.begin() + offset);
+
+        const std::string written = describe(area, offset, length);
+
+        // The written range with the words around it, which the read-modify-write of the head and tail must keep.
+        const size_t margin = 2 * sizeof(Process::Register);
+        const size_t first = offset > margin ? offset - margin : 0;
+
+        check(process, area, first, std::min(areaSize, offset + length + margin) - first, written);
+
+        // And a random read, to cover the read side on its own.
+        const size_t readLength = randomLength(random, areaSize);
+
+        check(process, area, random() % (areaSize - readLength + 1), readLength, written);
+    }
+
+    for(const auto &area : areas)
+        check(process, area, 0, areaSize, "everything");
+}
+
+Process::MemoryAddress getInstructionPointer(const Process::ProcessRegisters &registers)
+{
+#ifdef __x86_64__
+    return registers.rip;
+#elif defined __i386__
+    return registers.eip;
+#endif
+}
+
+/**
+ * @brief checkPushAndCall  push() mixed-size values and call() with the stack pointer at the end of @arg area,
+ * then restore the registers.
+ */
+void checkPushAndCall(Process &process, const Area &area)
+{
+    const auto savedRegisters = process.getProcessRegisters();
+    const Process::MemoryAddress stackTop = reinterpret_cast<Process::MemoryAddress>(area.address + areaSize);
+
+    auto registers = savedRegisters;
+
+    Process::setStackPointer(registers, stackTop);
+    process.setProcesssRegisters(registers);
+
+    const uint8_t byteValue = 0x11;
+    const uint16_t shortValue = 0x2233;
+    const uint32_t intValue = 0x44556677;
+    const uint64_t longValue = 0x8899aabbccddeeffULL;
+    const size_t packSize = sizeof(byteValue) + sizeof(shortValue) + sizeof(intValue) + sizeof(longValue);
+
+    const Process::MemoryAddress stackPointer = process.push(byteValue, shortValue, intValue, longValue);
+
+    if(stackPointer != stackTop - static_cast<Process::MemoryAddress>(packSize) ||
+            Process::getStackPointer(process.getProcessRegisters()) != stackPointer)
+        throw std::runtime_error(std::string(area.name) + ": push() left the stack pointer at the wrong place");
+
+    // Packed without padding, the last value on the top and the first one right below the old stack pointer.
+    std::vector<Process::Byte> expected(packSize);
+    Process::Byte *position = expected.data();
+
+    std::memcpy(position, &longValue, sizeof(longValue));
+    std::memcpy(position += sizeof(longValue), &intValue, sizeof(intValue));
+    std::memcpy(position += sizeof(intValue), &shortValue, sizeof(shortValue));
+    std::memcpy(position += sizeof(shortValue), &byteValue, sizeof(byteValue));
+
+    if(process.read(stackPointer, packSize) != expected)
+        throw std::runtime_error(std::string(area.name) + ": push() stacked the wrong bytes");
+
+    // Any address will do, call() only sets the registers and the stack.
+    const Process::MemoryAddress target = reinterpret_cast<Process::MemoryAddress>(&checkPushAndCall);
+
+    process.call(target);
+
+    registers = process.getProcessRegisters();
+
+    const Process::MemoryAddress callStackPointer = Process::getStackPointer(registers);
+    Process::Register returnAddress;
+
+    process.read(callStackPointer, &returnAddress, sizeof(returnAddress));
+
+    if(getInstructionPointer(registers) != target || callStackPointer != stackPointer - static_cast<Process::MemoryAddress>(sizeof(returnAddress)))
+        throw std::runtime_error(std::string(area.name) + ": call() didn't jump or didn't push");
+
+    // Returning (pop the address into the instruction pointer) must bring the process back to where it was.
+    Process::setStackPointer(registers, callStackPointer + sizeof(returnAddress));
+    process.setProcesssRegisters(registers);
+    process.jump(returnAddress);
+
+    registers = process.getProcessRegisters();
+
+    if(getInstructionPointer(registers) != getInstructionPointer(savedRegisters) || Process::getStackPointer(registers) != stackPointer)
+        throw std::runtime_error(std::string(area.name) + ": returning from call() didn't restore the registers");
+
+    process.setProcesssRegisters(savedRegisters);
+}
+
+void usage(const char *programName)
+{
+    std::cerr << "Usage: " << programName << " [--seed seed] [--iterations count]" << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long seed = std::random_device()();
+    unsigned long iterations = 20000;
+
+    for(int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+
+        if(argument == "--seed" && i+1 < argc) {
+            seed = std::strtoul(argv[++i], nullptr, 0);
+        }
+        else if(argument == "--iterations" && i+1 < argc) {
+            iterations = std::strtoul(argv[++i], nullptr, 0);
+        }
+        else {
+            usage(argv[0]);
+
+            return 1;
+        }
+    }
+
+    std::mt19937 random(seed);
+    std::vector<Area> areas;
+
+    for(const char *name : { "writable", "read-only" }) {
+        void *address = ::mmap(nullptr, areaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if(address == MAP_FAILED) {
+            std::perror("mmap");
+
+            return 1;
+        }
+
+        areas.push_back(Area{ name, static_cast<Process::Byte *>(address), std::vector<Process::Byte>(areaSize) });
+
+        for(auto &byte : areas.back().model)
+            byte = random();
+
+        std::copy(areas.back().model.begin(), areas.back().model.end(), areas.back().address);
+    }
+
+    // process_vm_writev() respects the protection, ptrace doesn't: writes here must take the fallback.
+    ::mprotect(areas[1].address, areaSize, PROT_READ);
+
+    const pid_t child = ::fork();
+
+    if(child < 0) {
+        std::perror("fork");
+
+        return 1;
+    }
+
+    if(child == 0) {
+        while(true)
+            ::pause();
+    }
+
+    int result = 0;
+
+    try {
+        Process process(child);
+
+        run(process, areas, random, iterations);
+
+        for(const auto &area : areas)
+            checkPushAndCall(process, area);
+
+        std::cout << "memorytest: " << iterations << " transfers passed (seed " << seed << ")" << std::endl;
+    }
+    catch(const std::exception &exception) {
+        std::cerr << "memorytest failed (seed " << seed << "): " << exception.what() << std::endl;
+
+        result = 1;
+    }
+
+    ::kill(child, SIGKILL);
+    ::waitpid(child, nullptr, 0);
+
+    return result;
+}
@@ -0,0 +1,16 @@
+TEMPLATE = app
+TARGET = memorytest
+INCLUDEPATH += . ../Source
+
+CONFIG += console
+CONFIG += c++11
+CONFIG -= qt
+
+# "make check" runs the test.
+CONFIG += testcase
+
+LIBS += -L../Source -lSource
+PRE_TARGETDEPS += ../Source/libSource.so
+
+# Input
+SOURCES += memorytest.cpp
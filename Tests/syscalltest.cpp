@@ -0,0 +1,256 @@
+/**
+ * @file
+ * @author shrek0 (shrek0.tk@gmail.com)
+ * @class
+ * @section LICENSE
+ *
+ * Process copyright (C) 2015 shrek0
+ *
+ * Process is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Tests of SyscallRecorder/SyscallReplayer on forked children: recording a program that execs, and replaying
+ * output buffers into a process whose buffer isn't where it was when recording.
+ */
+
+
+#include <process.h>
+#include <syscalllog.h>
+#include <syscallrecorder.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// Set through ptrace once the recorder is ready; the children spin on it without making system calls.
+volatile int go = 0;
+
+// The replayed child reads into another part of the area than the recorded one.
+char area[64];
+size_t areaOffset = 0;
+
+const size_t randomBytesCount = 16;
+
+std::string logPath()
+{
+    return "/tmp/syscalltest-" + std::to_string(::getpid()) + ".log";
+}
+
+/**
+ * @brief spawn  Fork a child that runs @arg child once go is set. Returns once the child spins, so the recording and
+ * the replay both start at the same point (after the system calls of the fork itself).
+ */
+pid_t spawn(void (*child)())
+{
+    int readyPipe[2];
+
+    if(::pipe(readyPipe) < 0)
+        throw std::runtime_error("pipe() failed");
+
+    const pid_t processID = ::fork();
+
+    if(processID < 0)
+        throw std::runtime_error("fork() failed");
+
+    if(processID == 0) {
+        const char ready = 'r';
+
+        if(::write(readyPipe[1], &ready, 1) != 1)
+            ::_exit(1);
+
+        while(go == 0)
+            ;
+
+        child();
+
+        ::_exit(0);
+    }
+
+    char ready;
+
+    const ssize_t bytesRead = ::read(readyPipe[0], &ready, 1);
+
+    ::close(readyPipe[0]);
+    ::close(readyPipe[1]);
+
+    if(bytesRead != 1)
+        throw std::runtime_error("the child didn't start");
+
+    return processID;
+}
+
+void execChild()
+{
+    ::execl("/bin/true", "true", static_cast<char *>(nullptr));
+}
+
+void randomChild()
+{
+    ::syscall(SYS_getrandom, area + areaOffset, randomBytesCount, 0);
+}
+
+/**
+ * @brief record  Record @arg child from the end of its spin to its exit.
+ * @return The recorded records, in order.
+ */
+std::vector<SyscallRecord> record(void (*child)(), pid_t &processID)
+{
+    processID = spawn(child);
+
+    {
+        Process process(processID);
+        SyscallLogWriter writer(logPath());
+        SyscallRecorder recorder(process, writer);
+
+        process.move(1, reinterpret_cast<Process::MemoryAddress>(&go));
+
+        while(recorder.recordNext())
+            ;
+    }
+
+    ::waitpid(processID, nullptr, WNOHANG);
+
+    std::vector<SyscallRecord> records;
+    SyscallLogReader reader(logPath());
+    SyscallRecord record;
+
+    while(reader.nextOfStream(processID, record))
+        records.push_back(record);
+
+    ::unlink(logPath().c_str());
+
+    return records;
+}
+
+void testExec()
+{
+    pid_t processID;
+    const auto records = record(execChild, processID);
+
+    const bool execved = std::any_of(records.begin(), records.end(), [](const SyscallRecord &record) {
+        return record.number == SYS_execve && record.returnValue == 0;
+    });
+
+    if(!execved)
+        throw std::runtime_error("exec: no successful execve() recorded");
+
+    // A tracee killed by the post-exec SIGTRAP never gets to exit_group().
+    if(records.back().number != SYS_exit_group)
+        throw std::runtime_error("exec: the program didn't run to its exit, last system call " + std::to_string(records.back().number));
+}
+
+void testReplayDestination()
+{
+    pid_t recordedID;
+
+    areaOffset = 0;
+
+    const auto records = record(randomChild, recordedID);
+
+    auto recorded = std::find_if(records.begin(), records.end(), [](const SyscallRecord &record) {
+        return record.number == SYS_getrandom;
+    });
+
+    if(recorded == records.end() || recorded->buffers.size() != 1)
+        throw std::runtime_error("replay: getrandom() wasn't recorded");
+
+    // Write the log again, for the replay.
+    {
+        SyscallLogWriter writer(logPath());
+        auto &ring = writer.createRing(recordedID);
+
+        for(const auto &record : records)
+            ring.append(record);
+    }
+
+    areaOffset = 32;
+
+    const pid_t processID = spawn(randomChild);
+    std::vector<Process::Byte> replayedArea;
+
+    try {
+        Process process(processID);
+        SyscallLogReader reader(logPath());
+        SyscallReplayer replayer(process, reader, recordedID);
+
+        process.move(1, reinterpret_cast<Process::MemoryAddress>(&go));
+
+        // The first call is getrandom(); look at the area before the process goes on.
+        replayer.replayNext();
+
+        replayedArea = process.read(reinterpret_cast<Process::MemoryAddress>(area), sizeof(area));
+
+        while(replayer.replayNext())
+            ;
+    }
+    catch(...) {
+        ::unlink(logPath().c_str());
+        ::kill(processID, SIGKILL);
+        ::waitpid(processID, nullptr, 0);
+
+        throw;
+    }
+
+    ::unlink(logPath().c_str());
+    ::waitpid(processID, nullptr, WNOHANG);
+
+    const auto &bytes = recorded->buffers[0].bytes;
+
+    if(!std::equal(bytes.begin(), bytes.end(), replayedArea.begin() + areaOffset))
+        throw std::runtime_error("replay: the output didn't go to the live buffer");
+
+    if(std::any_of(replayedArea.begin(), replayedArea.begin() + areaOffset, [](Process::Byte byte) { return byte != 0; }))
+        throw std::runtime_error("replay: the output went to the recorded address");
+}
+
+}
+
+int main()
+{
+    const struct {
+        const char *name;
+        void (*function)();
+    } tests[] = {
+        { "exec", testExec },
+        { "replay_destination", testReplayDestination },
+    };
+
+    int result = 0;
+
+    for(const auto &test : tests) {
+        try {
+            test.function();
+
+            std::cout << "syscalltest: " << test.name << " passed" << std::endl;
+        }
+        catch(const std::exception &exception) {
+            std::cerr << "syscalltest: " << test.name << " failed: " << exception.what() << std::endl;
+
+            result = 1;
+        }
+    }
+
+    return result;
+}
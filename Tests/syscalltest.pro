@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = syscalltest
+INCLUDEPATH += . ../Source
+
+CONFIG += console
+CONFIG += c++11
+CONFIG += thread
+CONFIG -= qt
+
+# "make check" runs the test.
+CONFIG += testcase
+
+LIBS += -L../Source -lSource
+PRE_TARGETDEPS += ../Source/libSource.so
+
+# Input
+SOURCES += syscalltest.cpp